@@ -123,25 +123,106 @@ static struct allowedips_node *find_node(struct allowedips_node *trie, u8 bits,
 	return found;
 }
 
+static unsigned int jump_index(const u8 *key, u8 bits)
+{
+	if (bits == 32)
+		return *(const u32 *)key >> (32U - ALLOWEDIPS_JUMP_BITS);
+	return *(const u64 *)key >> (64U - ALLOWEDIPS_JUMP_BITS);
+}
+
+static void jump_fill_slot(struct allowedips_jump *jump,
+			   struct allowedips_node __rcu *trie, u8 bits,
+			   unsigned int index, struct mutex *lock)
+{
+	/* Aligned so it can be passed to fls/fls64 */
+	u8 key[16] __aligned(__alignof(u64)) = { 0 };
+	struct allowedips_node *node, *best = NULL;
+
+	if (bits == 32)
+		*(u32 *)key = index << (32U - ALLOWEDIPS_JUMP_BITS);
+	else
+		*(u64 *)key = (u64)index << (64U - ALLOWEDIPS_JUMP_BITS);
+
+	/* Only the first ALLOWEDIPS_JUMP_BITS of key are known, so walk down
+	 * as long as nodes branch on those.
+	 */
+	node = rcu_dereference_protected(trie, lockdep_is_held(lock));
+	while (node && node->cidr < ALLOWEDIPS_JUMP_BITS &&
+	       prefix_matches(node, key, bits)) {
+		if (rcu_access_pointer(node->peer))
+			best = node;
+		node = rcu_dereference_protected(node->bit[choose(node, key)],
+						 lockdep_is_held(lock));
+	}
+	if (node && node->cidr < ALLOWEDIPS_JUMP_BITS)
+		node = NULL;
+
+	rcu_assign_pointer(jump->slot[index].start, node);
+	rcu_assign_pointer(jump->slot[index].best, best);
+}
+
+/* Refresh the slots covered by key/cidr, after nodes up to that prefix
+ * changed.
+ */
+static void jump_refresh(struct allowedips_jump __rcu *jump_ptr,
+			 struct allowedips_node __rcu *trie, u8 bits,
+			 const u8 *key, u8 cidr, struct mutex *lock)
+{
+	struct allowedips_jump *jump = rcu_dereference_protected(jump_ptr,
+							lockdep_is_held(lock));
+	unsigned int shift = ALLOWEDIPS_JUMP_BITS - min_t(u8, cidr, ALLOWEDIPS_JUMP_BITS);
+	unsigned int index = jump_index(key, bits) >> shift << shift;
+	unsigned int end = index + (1U << shift);
+
+	if (!jump)
+		return;
+	for (; index < end; ++index)
+		jump_fill_slot(jump, trie, bits, index, lock);
+}
+
+static int jump_alloc(struct allowedips_jump __rcu **jump_ptr,
+		      struct mutex *lock)
+{
+	struct allowedips_jump *jump;
+
+	if (rcu_access_pointer(*jump_ptr))
+		return 0;
+	jump = kzalloc(sizeof(*jump), GFP_KERNEL);
+	if (unlikely(!jump))
+		return -ENOMEM;
+	rcu_assign_pointer(*jump_ptr, jump);
+	return 0;
+}
+
 /* Returns a strong reference to a peer */
-static struct wg_peer *lookup(struct allowedips_node __rcu *root, u8 bits,
+static struct wg_peer *lookup(struct allowedips_jump __rcu *jump_ptr, u8 bits,
 			      const void *be_ip)
 {
 	/* Aligned so it can be passed to fls/fls64 */
 	u8 ip[16] __aligned(__alignof(u64));
-	struct allowedips_node *node;
+	struct allowedips_node *node, *best;
+	struct allowedips_jump *jump;
 	struct wg_peer *peer = NULL;
+	unsigned int index;
 
 	swap_endian(ip, be_ip, bits);
+	index = jump_index(ip, bits);
 
 	rcu_read_lock_bh();
+	jump = rcu_dereference_bh(jump_ptr);
+	if (unlikely(!jump))
+		goto out;
 retry:
-	node = find_node(rcu_dereference_bh(root), bits, ip);
+	best = rcu_dereference_bh(jump->slot[index].best);
+	node = find_node(rcu_dereference_bh(jump->slot[index].start), bits, ip);
+	if (!node && best && rcu_access_pointer(best->peer))
+		node = best;
 	if (node) {
 		peer = wg_peer_get_maybe_zero(rcu_dereference_bh(node->peer));
 		if (!peer)
 			goto retry;
 	}
+out:
 	rcu_read_unlock_bh();
 	return peer;
 }
@@ -178,7 +259,8 @@ static inline void choose_and_connect_node(struct allowedips_node *parent, struc
 	connect_node(&parent->bit[bit], bit, node);
 }
 
-static int add(struct allowedips_node __rcu **trie, u8 bits, const u8 *key,
+static int add(struct allowedips_node __rcu **trie,
+	       struct allowedips_jump __rcu *jump, u8 bits, const u8 *key,
 	       u8 cidr, struct wg_peer *peer, struct mutex *lock)
 {
 	struct allowedips_node *node, *parent, *down, *newnode;
@@ -194,12 +276,12 @@ static int add(struct allowedips_node __rcu **trie, u8 bits, const u8 *key,
 		list_add_tail(&node->peer_list, &peer->allowedips_list);
 		copy_and_assign_cidr(node, key, cidr, bits);
 		connect_node(trie, 2, node);
-		return 0;
+		goto refresh;
 	}
 	if (node_placement(*trie, key, cidr, bits, &node, lock)) {
 		rcu_assign_pointer(node->peer, peer);
 		list_move_tail(&node->peer_list, &peer->allowedips_list);
-		return 0;
+		goto refresh;
 	}
 
 	newnode = kmem_cache_zalloc(node_cache, GFP_KERNEL);
@@ -216,7 +298,7 @@ static int add(struct allowedips_node __rcu **trie, u8 bits, const u8 *key,
 		down = rcu_dereference_protected(node->bit[bit], lockdep_is_held(lock));
 		if (!down) {
 			connect_node(&node->bit[bit], bit, newnode);
-			return 0;
+			goto refresh;
 		}
 	}
 	cidr = min(cidr, common_bits(down, key, bits));
@@ -228,7 +310,7 @@ static int add(struct allowedips_node __rcu **trie, u8 bits, const u8 *key,
 			connect_node(trie, 2, newnode);
 		else
 			choose_and_connect_node(parent, newnode);
-		return 0;
+		goto refresh;
 	}
 
 	node = kmem_cache_zalloc(node_cache, GFP_KERNEL);
@@ -246,22 +328,36 @@ static int add(struct allowedips_node __rcu **trie, u8 bits, const u8 *key,
 		connect_node(trie, 2, node);
 	else
 		choose_and_connect_node(parent, node);
+
+refresh:
+	/* Nodes down from key/cidr changed, cidr being the shortest prefix */
+	jump_refresh(jump, *trie, bits, key, cidr, lock);
 	return 0;
 }
 
 void wg_allowedips_init(struct allowedips *table)
 {
 	table->root4 = table->root6 = NULL;
+	table->jump4 = table->jump6 = NULL;
 	table->seq = 1;
 }
 
 void wg_allowedips_free(struct allowedips *table, struct mutex *lock)
 {
 	struct allowedips_node __rcu *old4 = table->root4, *old6 = table->root6;
+	struct allowedips_jump *jump4, *jump6;
 
 	++table->seq;
+	jump4 = rcu_dereference_protected(table->jump4, lockdep_is_held(lock));
+	jump6 = rcu_dereference_protected(table->jump6, lockdep_is_held(lock));
+	RCU_INIT_POINTER(table->jump4, NULL);
+	RCU_INIT_POINTER(table->jump6, NULL);
 	RCU_INIT_POINTER(table->root4, NULL);
 	RCU_INIT_POINTER(table->root6, NULL);
+	if (jump4)
+		kfree_rcu(jump4, rcu);
+	if (jump6)
+		kfree_rcu(jump6, rcu);
 	if (rcu_access_pointer(old4)) {
 		struct allowedips_node *node = rcu_dereference_protected(old4,
 							lockdep_is_held(lock));
@@ -283,10 +379,14 @@ int wg_allowedips_insert_v4(struct allowedips *table, const struct in_addr *ip,
 {
 	/* Aligned so it can be passed to fls */
 	u8 key[4] __aligned(__alignof(u32));
+	int ret;
 
+	ret = jump_alloc(&table->jump4, lock);
+	if (unlikely(ret))
+		return ret;
 	++table->seq;
 	swap_endian(key, (const u8 *)ip, 32);
-	return add(&table->root4, 32, key, cidr, peer, lock);
+	return add(&table->root4, table->jump4, 32, key, cidr, peer, lock);
 }
 
 int wg_allowedips_insert_v6(struct allowedips *table, const struct in6_addr *ip,
@@ -294,10 +394,27 @@ int wg_allowedips_insert_v6(struct allowedips *table, const struct in6_addr *ip,
 {
 	/* Aligned so it can be passed to fls64 */
 	u8 key[16] __aligned(__alignof(u64));
+	int ret;
 
+	ret = jump_alloc(&table->jump6, lock);
+	if (unlikely(ret))
+		return ret;
 	++table->seq;
 	swap_endian(key, (const u8 *)ip, 128);
-	return add(&table->root6, 128, key, cidr, peer, lock);
+	return add(&table->root6, table->jump6, 128, key, cidr, peer, lock);
+}
+
+/* Nodes unlinked or without peer anymore must not stay in the jump table */
+static void refresh_removed(struct allowedips *table,
+			    struct allowedips_node *node, u8 cidr,
+			    struct mutex *lock)
+{
+	if (node->bitlen == 32)
+		jump_refresh(table->jump4, table->root4, 32, node->bits, cidr,
+			     lock);
+	else
+		jump_refresh(table->jump6, table->root6, 128, node->bits, cidr,
+			     lock);
 }
 
 void wg_allowedips_remove_by_peer(struct allowedips *table,
@@ -312,8 +429,10 @@ void wg_allowedips_remove_by_peer(struct allowedips *table,
 	list_for_each_entry_safe(node, tmp, &peer->allowedips_list, peer_list) {
 		list_del_init(&node->peer_list);
 		RCU_INIT_POINTER(node->peer, NULL);
-		if (node->bit[0] && node->bit[1])
+		if (node->bit[0] && node->bit[1]) {
+			refresh_removed(table, node, node->cidr, lock);
 			continue;
+		}
 		child = rcu_dereference_protected(node->bit[!rcu_access_pointer(node->bit[0])],
 						  lockdep_is_held(lock));
 		if (child)
@@ -330,12 +449,16 @@ void wg_allowedips_remove_by_peer(struct allowedips *table,
 			child = rcu_dereference_protected(
 					parent->bit[!(node->parent_bit_packed & 1)],
 					lockdep_is_held(lock));
-		call_rcu(&node->rcu, node_free_rcu);
-		if (!free_parent)
+		if (!free_parent) {
+			refresh_removed(table, node, node->cidr, lock);
+			call_rcu(&node->rcu, node_free_rcu);
 			continue;
+		}
 		if (child)
 			child->parent_bit_packed = parent->parent_bit_packed;
 		*(struct allowedips_node **)(parent->parent_bit_packed & ~3UL) = child;
+		refresh_removed(table, node, parent->cidr, lock);
+		call_rcu(&node->rcu, node_free_rcu);
 		call_rcu(&parent->rcu, node_free_rcu);
 	}
 }
@@ -357,9 +480,9 @@ struct wg_peer *wg_allowedips_lookup_dst(struct allowedips *table,
 					 struct sk_buff *skb)
 {
 	if (skb->protocol == htons(ETH_P_IP))
-		return lookup(table->root4, 32, &ip_hdr(skb)->daddr);
+		return lookup(table->jump4, 32, &ip_hdr(skb)->daddr);
 	else if (skb->protocol == htons(ETH_P_IPV6))
-		return lookup(table->root6, 128, &ipv6_hdr(skb)->daddr);
+		return lookup(table->jump6, 128, &ipv6_hdr(skb)->daddr);
 	return NULL;
 }
 
@@ -368,9 +491,9 @@ struct wg_peer *wg_allowedips_lookup_src(struct allowedips *table,
 					 struct sk_buff *skb)
 {
 	if (skb->protocol == htons(ETH_P_IP))
-		return lookup(table->root4, 32, &ip_hdr(skb)->saddr);
+		return lookup(table->jump4, 32, &ip_hdr(skb)->saddr);
 	else if (skb->protocol == htons(ETH_P_IPV6))
-		return lookup(table->root6, 128, &ipv6_hdr(skb)->saddr);
+		return lookup(table->jump6, 128, &ipv6_hdr(skb)->saddr);
 	return NULL;
 }
 
@@ -26,9 +26,25 @@ struct allowedips_node {
 	};
 };
 
+enum { ALLOWEDIPS_JUMP_BITS = 8 };
+
+/* Direct-indexed first level, by the top ALLOWEDIPS_JUMP_BITS of an address:
+ * the node to resume the trie walk from, and the longest matching prefix with
+ * a peer above it, so lookups skip the densest levels of the trie.
+ */
+struct allowedips_jump {
+	struct {
+		struct allowedips_node __rcu *start;
+		struct allowedips_node __rcu *best;
+	} slot[1U << ALLOWEDIPS_JUMP_BITS];
+	struct rcu_head rcu;
+};
+
 struct allowedips {
 	struct allowedips_node __rcu *root4;
 	struct allowedips_node __rcu *root6;
+	struct allowedips_jump __rcu *jump4;
+	struct allowedips_jump __rcu *jump6;
 	u64 seq;
 } __aligned(4); /* We pack the lower 2 bits of &root, but m68k only gives 16-bit alignment. */
 
@@ -29,6 +29,8 @@ struct crypt_queue {
 	struct ptr_ring ring;
 	struct multicore_worker __percpu *worker;
 	int last_cpu;
+	int burst_cpu;
+	unsigned int burst;
 };
 
 struct prev_queue {
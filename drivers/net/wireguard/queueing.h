@@ -134,6 +134,20 @@ static inline int wg_cpumask_next_online(int *next)
 	return cpu;
 }
 
+/* Like wg_cpumask_next_online, but only moves on to the next CPU every
+ * MAX_CRYPT_BATCH packets. All the workers consume from the same ring, so
+ * kicking a different one for each packet just has them contend on the ring
+ * for one packet each, while bursts let a worker take a batch at a time. This
+ * is racy in the same way, which is fine.
+ */
+static inline int wg_cpumask_next_online_burst(struct crypt_queue *queue)
+{
+	if (!(queue->burst++ % MAX_CRYPT_BATCH) ||
+	    unlikely(!cpumask_test_cpu(queue->burst_cpu, cpu_online_mask)))
+		queue->burst_cpu = wg_cpumask_next_online(&queue->last_cpu);
+	return queue->burst_cpu;
+}
+
 void wg_prev_queue_init(struct prev_queue *queue);
 
 /* Multi producer */
@@ -159,7 +173,7 @@ static inline void wg_prev_queue_drop_peeked(struct prev_queue *queue)
 
 static inline int wg_queue_enqueue_per_device_and_peer(
 	struct crypt_queue *device_queue, struct prev_queue *peer_queue,
-	struct sk_buff *skb, struct workqueue_struct *wq, int *next_cpu)
+	struct sk_buff *skb, struct workqueue_struct *wq)
 {
 	int cpu;
 
@@ -173,7 +187,7 @@ static inline int wg_queue_enqueue_per_device_and_peer(
 	/* Then we queue it up in the device queue, which consumes the
 	 * packet as soon as it can.
 	 */
-	cpu = wg_cpumask_next_online(next_cpu);
+	cpu = wg_cpumask_next_online_burst(device_queue);
 	if (unlikely(ptr_ring_produce_bh(&device_queue->ring, skb)))
 		return -EPIPE;
 	queue_work_on(cpu, wq, &per_cpu_ptr(device_queue->worker, cpu)->work);
@@ -288,21 +288,25 @@ void wg_packet_encrypt_worker(struct work_struct *work)
 {
 	struct crypt_queue *queue = container_of(work, struct multicore_worker,
 						 work)->ptr;
-	struct sk_buff *first, *skb, *next;
-
-	while ((first = ptr_ring_consume_bh(&queue->ring)) != NULL) {
-		enum packet_state state = PACKET_STATE_CRYPTED;
-
-		skb_list_walk_safe(first, skb, next) {
-			if (likely(encrypt_packet(skb,
-					PACKET_CB(first)->keypair))) {
-				wg_reset_packet(skb, true);
-			} else {
-				state = PACKET_STATE_DEAD;
-				break;
+	struct sk_buff *firsts[MAX_CRYPT_BATCH], *skb, *next;
+	int i, n;
+
+	while ((n = ptr_ring_consume_batched_bh(&queue->ring, (void **)firsts,
+						ARRAY_SIZE(firsts))) != 0) {
+		for (i = 0; i < n; ++i) {
+			enum packet_state state = PACKET_STATE_CRYPTED;
+
+			skb_list_walk_safe(firsts[i], skb, next) {
+				if (likely(encrypt_packet(skb,
+						PACKET_CB(firsts[i])->keypair))) {
+					wg_reset_packet(skb, true);
+				} else {
+					state = PACKET_STATE_DEAD;
+					break;
+				}
 			}
+			wg_queue_enqueue_per_peer_tx(firsts[i], state);
 		}
-		wg_queue_enqueue_per_peer_tx(first, state);
 		if (need_resched())
 			cond_resched();
 	}
@@ -318,7 +322,7 @@ static void wg_packet_create_data(struct wg_peer *peer, struct sk_buff *first)
 		goto err;
 
 	ret = wg_queue_enqueue_per_device_and_peer(&wg->encrypt_queue, &peer->tx_queue, first,
-						   wg->packet_crypt_wq, &wg->encrypt_queue.last_cpu);
+						   wg->packet_crypt_wq);
 	if (unlikely(ret == -EPIPE))
 		wg_queue_enqueue_per_peer_tx(first, PACKET_STATE_DEAD);
 err:
@@ -321,7 +321,12 @@ struct gro_list {
  * size of gro hash buckets, must less than bit number of
  * napi_struct::gro_bitmask
  */
-#define GRO_HASH_BUCKETS	8
+#if BITS_PER_LONG == 64
+#define GRO_HASH_BITS		5
+#else
+#define GRO_HASH_BITS		4
+#endif
+#define GRO_HASH_BUCKETS	(1 << GRO_HASH_BITS)
 
 /*
  * Structure for NAPI scheduling similar to tasklet but with weighting
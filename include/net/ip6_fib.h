@@ -383,6 +383,8 @@ struct rt6_statistics {
  */
 
 
+struct fib6_dir;
+
 struct fib6_table {
 	struct hlist_node	tb6_hlist;
 	u32			tb6_id;
@@ -392,6 +394,8 @@ struct fib6_table {
 	unsigned int		flags;
 	unsigned int		fib_seq;
 #define RT6_TABLE_HAS_DFLT_ROUTER	BIT(0)
+	struct fib6_dir __rcu	*tb6_dir;
+	unsigned int		tb6_routes;
 };
 
 #define RT6_TABLE_UNSPEC	RT_TABLE_UNSPEC
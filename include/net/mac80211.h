@@ -4748,7 +4748,8 @@ void ieee80211_rx_list(struct ieee80211_hw *hw, struct ieee80211_sta *sta,
  * @hw: the hardware this frame came in on
  * @sta: the station the frame was received from, or %NULL
  * @skb: the buffer to receive, owned by mac80211 after this call
- * @napi: the NAPI context
+ * @napi: the NAPI context, or %NULL in which case frames are run through
+ *	the receiving interface's GRO cells before reaching the stack
  */
 void ieee80211_rx_napi(struct ieee80211_hw *hw, struct ieee80211_sta *sta,
 		       struct sk_buff *skb, struct napi_struct *napi);
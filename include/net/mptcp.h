@@ -59,6 +59,28 @@ struct mptcp_addr_info {
 	};
 };
 
+#define MPTCP_SCHED_NAME_MAX	16
+
+struct mptcp_sched_stats {
+	u64		picks;	/* a subflow was returned */
+	u64		busy;	/* no subflow could take more data */
+};
+
+/* Packet scheduler: get_subflow() is called with the msk socket lock held
+ * and returns the subflow that will carry the next chunk of data, or NULL
+ * if none can send right now. init() and release() are optional.
+ */
+struct mptcp_sched_ops {
+	struct sock *(*get_subflow)(struct mptcp_sock *msk);
+	void (*init)(struct mptcp_sock *msk);
+	void (*release)(struct mptcp_sock *msk);
+
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+	struct list_head	list;
+	struct mptcp_sched_stats __percpu *stats;
+};
+
 struct mptcp_out_options {
 #if IS_ENABLED(CONFIG_MPTCP)
 	u16 suboptions;
@@ -131,6 +153,9 @@ void mptcp_write_options(struct tcphdr *th, __be32 *ptr, struct tcp_sock *tp,
 
 void mptcp_diag_fill_info(struct mptcp_sock *msk, struct mptcp_info *info);
 
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+
 /* move the skb extension owership, with the assumption that 'to' is
  * newly allocated
  */
@@ -112,6 +112,10 @@ struct nf_conn {
 	/* If we were expected by an expectation, this will be it */
 	struct nf_conn *master;
 
+	/* expiry wheel linkage, gc_wheel is the owning cpu + 1 (0: none) */
+	struct hlist_node gc_node;
+	u16 gc_wheel;
+
 #if defined(CONFIG_NF_CONNTRACK_MARK)
 	u_int32_t mark;
 #endif
@@ -55,6 +55,7 @@ struct netns_sysctl_ipv6 {
 	u64 ioam6_id_wide;
 	bool skip_notify_on_dev_down;
 	u8 fib_notify_on_flag_change;
+	u32 fib_dir_min_routes;
 };
 
 struct netns_ipv6 {
@@ -70,6 +71,8 @@ struct netns_ipv6 {
 	struct rt6_info		*ip6_null_entry;
 	struct rt6_statistics   *rt6_stats;
 	struct timer_list       ip6_fib_timer;
+	struct delayed_work	fib6_dir_work;
+	unsigned long		fib6_dir_deadline;
 	struct hlist_head       *fib_table_hash;
 	struct fib6_table       *fib6_main_tbl;
 	struct list_head	fib6_walkers;
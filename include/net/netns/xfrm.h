@@ -56,6 +56,10 @@ struct netns_xfrm {
 	struct work_struct	policy_hash_work;
 	struct xfrm_policy_hthresh policy_hthresh;
 	struct list_head	inexact_bins;
+	struct delayed_work	policy_tss_work;
+	unsigned int		policy_tss_genid;
+	unsigned int		policy_tss_nr;
+	unsigned long		policy_tss_deadline;
 
 
 	struct sock		*nlsk;
@@ -65,6 +69,8 @@ struct netns_xfrm {
 	u32			sysctl_aevent_rseqth;
 	int			sysctl_larval_drop;
 	u32			sysctl_acq_expires;
+	u32			sysctl_oseq_batch;
+	u32			sysctl_policy_tss_min;
 
 	u8			policy_default[XFRM_POLICY_MAX];
 
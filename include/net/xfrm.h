@@ -156,6 +156,17 @@ enum xfrm_replay_mode {
 	XFRM_REPLAY_MODE_ESN,
 };
 
+/* Outbound sequence numbers reserved by one CPU, and the lifetime usage it
+ * has not folded into curlft yet (see net.core.xfrm_oseq_batch).
+ */
+struct xfrm_state_cpu {
+	u32			oseq;		/* last number handed out */
+	u32			oseq_end;	/* last number reserved */
+	u32			gen;
+	u32			packets;
+	u64			bytes;
+};
+
 /* Full description of state of transformer. */
 struct xfrm_state {
 	possible_net_t		xs_net;
@@ -233,6 +244,15 @@ struct xfrm_state {
 
 	/* replay detection mode */
 	enum xfrm_replay_mode    repl_mode;
+
+	/* per-cpu blocks of output sequence numbers, bumping oseq_gen
+	 * drops them
+	 */
+	struct xfrm_state_cpu __percpu *pcpu;
+	u32			oseq_gen;
+	/* taken around folding per-cpu usage into curlft */
+	seqcount_t		lft_seq;
+
 	/* internal flag that only holds state for delayed aevent at the
 	 * moment
 	*/
@@ -1749,6 +1769,11 @@ void xfrm_replay_advance(struct xfrm_state *x, __be32 net_seq);
 int xfrm_replay_check(struct xfrm_state *x, struct sk_buff *skb, __be32 net_seq);
 void xfrm_replay_notify(struct xfrm_state *x, int event);
 int xfrm_replay_overflow(struct xfrm_state *x, struct sk_buff *skb);
+bool xfrm_replay_overflow_cached(struct xfrm_state *x, struct sk_buff *skb);
+void xfrm_replay_reserve(struct xfrm_state *x);
+void xfrm_state_fold_cpu(struct xfrm_state *x);
+void xfrm_state_curlft(const struct xfrm_state *x,
+		       struct xfrm_lifetime_cur *curlft);
 int xfrm_replay_recheck(struct xfrm_state *x, struct sk_buff *skb, __be32 net_seq);
 
 static inline int xfrm_aevent_is_on(struct net *net)
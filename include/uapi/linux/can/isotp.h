@@ -138,6 +138,20 @@ struct can_isotp_ll_options {
 #define CAN_ISOTP_SF_BROADCAST	0x0800	/* 1-to-N functional addressing */
 #define CAN_ISOTP_CF_BROADCAST	0x1000	/* 1-to-N transmission w/o FC */
 
+/*
+ * With CAN_ISOTP_TX_BATCH the consecutive frames of a block are handed
+ * to the CAN netdevice in batches of up to 16 frames (bounded by the
+ * tx_queue_len of the netdevice) instead of one frame per local echo.
+ * The frame_txtime (N_As) is not added between the frames of a batch
+ * as the netdevice serializes them on the bus.
+ * A non-zero STmin can only be honoured when SO_TXTIME is enabled on
+ * the socket: the frames then carry their earliest departure time in
+ * the SO_TXTIME clock and a qdisc like fq or etf has to be configured
+ * on the CAN netdevice to release them in time. Without SO_TXTIME a
+ * non-zero STmin falls back to the frame-by-frame transmission.
+ */
+#define CAN_ISOTP_TX_BATCH	0x2000	/* send CFs of a block in batches */
+
 /* protocol machine default values */
 
 #define CAN_ISOTP_DEFAULT_FLAGS		0
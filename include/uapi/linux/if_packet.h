@@ -128,6 +128,11 @@ struct tpacket_auxdata {
 
 /* Rx ring - feature request bits */
 #define TP_FT_REQ_FILL_RXHASH	0x1
+/* TPACKET_V3 only: let several RX CPUs fill the current block at once.
+ * Frames within a block are then not strictly in arrival order, and
+ * ts_first_pkt/ts_last_pkt hold the oldest/newest frame timestamp.
+ */
+#define TP_FT_REQ_MULTI_PRODUCER	0x2
 
 struct tpacket_hdr {
 	unsigned long	tp_status;
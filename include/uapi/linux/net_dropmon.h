@@ -58,6 +58,8 @@ enum {
 	NET_DM_CMD_CONFIG_NEW,
 	NET_DM_CMD_STATS_GET,
 	NET_DM_CMD_STATS_NEW,
+	NET_DM_CMD_AGGR_GET,
+	NET_DM_CMD_AGGR_NEW,
 	_NET_DM_CMD_MAX,
 };
 
@@ -94,6 +96,11 @@ enum net_dm_attr {
 	NET_DM_ATTR_HW_DROPS,			/* flag */
 	NET_DM_ATTR_FLOW_ACTION_COOKIE,		/* binary */
 	NET_DM_ATTR_REASON,			/* string */
+	NET_DM_ATTR_SAMPLE_RATE,		/* u32 */
+	NET_DM_ATTR_AGGR_ENTRIES,		/* nested */
+	NET_DM_ATTR_AGGR_ENTRY,			/* nested */
+	NET_DM_ATTR_AGGR_COUNT,			/* u64 */
+	NET_DM_ATTR_AGGR_RESET,			/* flag */
 
 	__NET_DM_ATTR_MAX,
 	NET_DM_ATTR_MAX = __NET_DM_ATTR_MAX - 1
@@ -104,10 +111,15 @@ enum net_dm_attr {
  * @NET_DM_ALERT_MODE_SUMMARY: A summary of recent drops is sent to user space.
  * @NET_DM_ALERT_MODE_PACKET: Each dropped packet is sent to user space along
  *                            with metadata.
+ * @NET_DM_ALERT_MODE_AGGREGATE: Drops are counted per drop reason, input
+ *                               port and protocol without sending alerts.
+ *                               The counters are read with
+ *                               NET_DM_CMD_AGGR_GET.
  */
 enum net_dm_alert_mode {
 	NET_DM_ALERT_MODE_SUMMARY,
 	NET_DM_ALERT_MODE_PACKET,
+	NET_DM_ALERT_MODE_AGGREGATE,
 };
 
 enum {
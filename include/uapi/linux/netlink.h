@@ -160,6 +160,10 @@ enum nlmsgerr_attrs {
 #define NETLINK_CAP_ACK			10
 #define NETLINK_EXT_ACK			11
 #define NETLINK_GET_STRICT_CHK		12
+/* Queue up to 32 dump skbs per round instead of one. Needs CAP_NET_ADMIN
+ * as the dump lock, the RTNL for rtnetlink, is held for the whole batch.
+ */
+#define NETLINK_DUMP_BATCH		13
 
 struct nl_pktinfo {
 	__u32	group;
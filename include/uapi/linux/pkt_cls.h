@@ -592,6 +592,10 @@ enum {
 	TCA_FLOWER_KEY_PPPOE_SID,	/* be16 */
 	TCA_FLOWER_KEY_PPP_PROTO,	/* be16 */
 
+	TCA_FLOWER_CACHE_HITS,		/* u64, classifier wide */
+	TCA_FLOWER_CACHE_MISSES,	/* u64, classifier wide */
+	TCA_FLOWER_PAD,
+
 	__TCA_FLOWER_MAX,
 };
 
@@ -34,6 +34,8 @@
 #define P9_PORT 564
 #define MAX_SOCK_BUF (1024*1024)
 #define MAXPOLLWADDR	2
+/* max reads or writes done by one run of the read/write work */
+#define P9_FD_WORK_BUDGET	16
 
 static struct p9_trans_module p9_tcp_trans;
 static struct p9_trans_module p9_fd_trans;
@@ -274,8 +276,9 @@ static int p9_fd_read(struct p9_client *client, void *v, int len)
 
 static void p9_read_work(struct work_struct *work)
 {
+	int budget = P9_FD_WORK_BUDGET;
 	__poll_t n;
-	int err;
+	int err, len;
 	struct p9_conn *m;
 
 	m = container_of(work, struct p9_conn, rq);
@@ -285,6 +288,7 @@ static void p9_read_work(struct work_struct *work)
 
 	p9_debug(P9_DEBUG_TRANS, "start mux %p pos %zd\n", m, m->rc.offset);
 
+again:
 	if (!m->rc.sdata) {
 		m->rc.sdata = m->tmp_buf;
 		m->rc.offset = 0;
@@ -295,8 +299,8 @@ static void p9_read_work(struct work_struct *work)
 	p9_debug(P9_DEBUG_TRANS, "read mux %p pos %zd size: %zd = %zd\n",
 		 m, m->rc.offset, m->rc.capacity,
 		 m->rc.capacity - m->rc.offset);
-	err = p9_fd_read(m->client, m->rc.sdata + m->rc.offset,
-			 m->rc.capacity - m->rc.offset);
+	len = m->rc.capacity - m->rc.offset;
+	err = p9_fd_read(m->client, m->rc.sdata + m->rc.offset, len);
 	p9_debug(P9_DEBUG_TRANS, "mux %p got %d bytes\n", m, err);
 	if (err == -EAGAIN)
 		goto end_clear;
@@ -305,6 +309,7 @@ static void p9_read_work(struct work_struct *work)
 		goto error;
 
 	m->rc.offset += err;
+	len -= err;
 
 	/* header read in */
 	if ((!m->rreq) && (m->rc.offset == m->rc.capacity)) {
@@ -383,6 +388,13 @@ static void p9_read_work(struct work_struct *work)
 		m->rreq = NULL;
 	}
 
+	/* A full read means more data is likely queued behind it, e.g. the
+	 * body following a header or the replies to pipelined requests, so
+	 * keep going instead of bouncing through poll and the workqueue.
+	 */
+	if (!len && --budget && m->err >= 0)
+		goto again;
+
 end_clear:
 	clear_bit(Rworksched, &m->wsched);
 
@@ -440,6 +452,7 @@ static int p9_fd_write(struct p9_client *client, void *v, int len)
 
 static void p9_write_work(struct work_struct *work)
 {
+	int budget = P9_FD_WORK_BUDGET;
 	__poll_t n;
 	int err;
 	struct p9_conn *m;
@@ -452,6 +465,7 @@ static void p9_write_work(struct work_struct *work)
 		return;
 	}
 
+again:
 	if (!m->wsize) {
 		spin_lock(&m->client->lock);
 		if (list_empty(&m->unsent_req_list)) {
@@ -495,6 +509,10 @@ static void p9_write_work(struct work_struct *work)
 		m->wpos = m->wsize = 0;
 		p9_req_put(m->client, m->wreq);
 		m->wreq = NULL;
+
+		/* the socket took the whole request, push the next one */
+		if (--budget && m->err >= 0)
+			goto again;
 	}
 
 end_clear:
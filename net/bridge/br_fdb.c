@@ -50,13 +50,39 @@ void br_fdb_fini(void)
 	kmem_cache_destroy(br_fdb_cache);
 }
 
+static void br_fdb_learn_work(struct work_struct *work);
+
 int br_fdb_hash_init(struct net_bridge *br)
 {
-	return rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	int err, cpu;
+
+	br->fdb_learn = alloc_percpu(struct net_bridge_fdb_learn_queue);
+	if (!br->fdb_learn)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct net_bridge_fdb_learn_queue *q;
+
+		q = per_cpu_ptr(br->fdb_learn, cpu);
+		spin_lock_init(&q->lock);
+		INIT_WORK(&q->work, br_fdb_learn_work);
+		q->br = br;
+	}
+
+	err = rhashtable_init(&br->fdb_hash_tbl, &br_fdb_rht_params);
+	if (err)
+		free_percpu(br->fdb_learn);
+
+	return err;
 }
 
 void br_fdb_hash_fini(struct net_bridge *br)
 {
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		cancel_work_sync(&per_cpu_ptr(br->fdb_learn, cpu)->work);
+	free_percpu(br->fdb_learn);
 	rhashtable_destroy(&br->fdb_hash_tbl);
 }
 
@@ -68,6 +94,15 @@ static inline unsigned long hold_time(const struct net_bridge *br)
 	return br->topology_change ? br->forward_delay : br->ageing_time;
 }
 
+/* Stamping fdb->updated on every frame bounces its cache line between all
+ * CPUs receiving from the same host, ageing only needs it to be accurate
+ * to a small fraction of the hold time.
+ */
+static inline unsigned long fdb_refresh_interval(const struct net_bridge *br)
+{
+	return min_t(unsigned long, hold_time(br) >> 4, HZ);
+}
+
 static inline int has_expired(const struct net_bridge *br,
 				  const struct net_bridge_fdb_entry *fdb)
 {
@@ -843,6 +878,99 @@ static bool __fdb_mark_active(struct net_bridge_fdb_entry *fdb)
 		  test_and_clear_bit(BR_FDB_NOTIFY_INACTIVE, &fdb->flags));
 }
 
+static void br_fdb_learn_drain(struct net_bridge_fdb_learn_queue *q)
+{
+	struct net_bridge_fdb_learn_entry ent[BR_FDB_LEARN_BATCH];
+	struct net_bridge *br = q->br;
+	unsigned int i, n;
+
+	spin_lock_bh(&q->lock);
+	n = q->count;
+	memcpy(ent, q->ent, n * sizeof(ent[0]));
+	q->count = 0;
+	spin_unlock_bh(&q->lock);
+
+	if (!n)
+		return;
+
+	spin_lock_bh(&br->hash_lock);
+	for (i = 0; i < n; i++) {
+		struct net_bridge_port *source = ent[i].source;
+		const unsigned char *addr = ent[i].key.addr.addr;
+		u16 vid = ent[i].key.vlan_id;
+		struct net_bridge_fdb_entry *fdb;
+
+		/* the port went down while the address was queued */
+		if (READ_ONCE(source->state) == BR_STATE_DISABLED)
+			continue;
+		/* learned meanwhile, moves are handled by the fast path */
+		if (br_fdb_find(br, addr, vid))
+			continue;
+
+		fdb = fdb_create(br, source, addr, vid, 0);
+		if (fdb) {
+			trace_br_fdb_update(br, source, addr, vid, 0);
+			fdb_notify(br, fdb, RTM_NEWNEIGH, true);
+		}
+	}
+	spin_unlock_bh(&br->hash_lock);
+}
+
+static void br_fdb_learn_work(struct work_struct *work)
+{
+	br_fdb_learn_drain(container_of(work, struct net_bridge_fdb_learn_queue,
+					work));
+}
+
+static void br_fdb_learn_enqueue(struct net_bridge_fdb_learn_queue *q,
+				 struct net_bridge_port *source,
+				 const unsigned char *addr, u16 vid)
+{
+	struct net_bridge_fdb_learn_entry *ent;
+	bool first, full;
+	unsigned int i;
+
+	spin_lock(&q->lock);
+	for (i = 0; i < q->count; i++) {
+		if (q->ent[i].key.vlan_id == vid &&
+		    ether_addr_equal(q->ent[i].key.addr.addr, addr)) {
+			spin_unlock(&q->lock);
+			return;
+		}
+	}
+
+	first = !q->count;
+	ent = &q->ent[q->count];
+	ent->source = source;
+	memcpy(ent->key.addr.addr, addr, ETH_ALEN);
+	ent->key.vlan_id = vid;
+	full = ++q->count == BR_FDB_LEARN_BATCH;
+	spin_unlock(&q->lock);
+
+	if (full)
+		br_fdb_learn_drain(q);
+	else if (first)
+		queue_work_on(smp_processor_id(), system_highpri_wq, &q->work);
+}
+
+/* Apply everything still queued. Entries whose port is disabled are
+ * dropped, so once a port is disabled and this returns no new entry can
+ * point at it; called again after the rx handler is gone to make sure no
+ * queue still references the port before it is freed.
+ */
+void br_fdb_learn_flush(struct net_bridge *br)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct net_bridge_fdb_learn_queue *q;
+
+		q = per_cpu_ptr(br->fdb_learn, cpu);
+		flush_work(&q->work);
+		br_fdb_learn_drain(q);
+	}
+}
+
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr, u16 vid, unsigned long flags)
 {
@@ -863,7 +991,8 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 			unsigned long now = jiffies;
 			bool fdb_modified = false;
 
-			if (now != fdb->updated) {
+			if (time_after(now, fdb->updated +
+					   fdb_refresh_interval(br))) {
 				fdb->updated = now;
 				fdb_modified = __fdb_mark_active(fdb);
 			}
@@ -889,7 +1018,20 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 			}
 		}
 	} else {
-		spin_lock(&br->hash_lock);
+		struct net_bridge_fdb_learn_queue *q = this_cpu_ptr(br->fdb_learn);
+
+		/* Learn inline while the lock is free. Under a learning storm
+		 * queue the address so the CPUs don't serialize on hash_lock
+		 * one frame at a time; user requests are never deferred.
+		 */
+		if (flags) {
+			spin_lock(&br->hash_lock);
+		} else if (READ_ONCE(q->count) ||
+			   !spin_trylock(&br->hash_lock)) {
+			br_fdb_learn_enqueue(q, source, addr, vid);
+			return;
+		}
+
 		fdb = fdb_create(br, source, addr, vid, flags);
 		if (fdb) {
 			trace_br_fdb_update(br, source, addr, vid, flags);
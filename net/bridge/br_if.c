@@ -344,6 +344,7 @@ static void del_nbp(struct net_bridge_port *p)
 	netdev_reset_rx_headroom(dev);
 
 	nbp_vlan_flush(p);
+	br_fdb_learn_flush(br);
 	br_fdb_delete_by_port(br, p, 0, 1);
 	switchdev_deferred_process();
 	nbp_backup_clear(p);
@@ -355,6 +356,7 @@ static void del_nbp(struct net_bridge_port *p)
 	dev->priv_flags &= ~IFF_BRIDGE_PORT;
 
 	netdev_rx_handler_unregister(dev);
+	br_fdb_learn_flush(br);
 
 	br_multicast_del_port(p);
 
@@ -274,6 +274,24 @@ struct net_bridge_fdb_entry {
 	struct rcu_head			rcu;
 };
 
+/* Addresses learned on the RX path while br->hash_lock is contended are
+ * parked per CPU and inserted in batches under a single lock acquisition.
+ */
+#define BR_FDB_LEARN_BATCH	16
+
+struct net_bridge_fdb_learn_entry {
+	struct net_bridge_port		*source;
+	struct net_bridge_fdb_key	key;
+};
+
+struct net_bridge_fdb_learn_queue {
+	spinlock_t			lock;
+	unsigned int			count;
+	struct net_bridge		*br;
+	struct work_struct		work;
+	struct net_bridge_fdb_learn_entry ent[BR_FDB_LEARN_BATCH];
+};
+
 struct net_bridge_fdb_flush_desc {
 	unsigned long			flags;
 	unsigned long			flags_mask;
@@ -540,6 +558,7 @@ struct net_bridge {
 	unsigned long			busy_hwdoms;
 #endif
 	struct hlist_head		fdb_list;
+	struct net_bridge_fdb_learn_queue __percpu *fdb_learn;
 
 #if IS_ENABLED(CONFIG_BRIDGE_MRP)
 	struct hlist_head		mrp_list;
@@ -771,6 +790,7 @@ int br_fdb_init(void);
 void br_fdb_fini(void);
 int br_fdb_hash_init(struct net_bridge *br);
 void br_fdb_hash_fini(struct net_bridge *br);
+void br_fdb_learn_flush(struct net_bridge *br);
 void br_fdb_flush(struct net_bridge *br,
 		  const struct net_bridge_fdb_flush_desc *desc);
 void br_fdb_find_delete_local(struct net_bridge *br,
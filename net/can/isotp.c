@@ -103,6 +103,9 @@ MODULE_ALIAS("can-proto-6");
 #define FF_PCI_SZ32 6	/* size of FirstFrame PCI including 32 bit FF_DL */
 #define FC_CONTENT_SZ 3	/* flow control content size in byte (FS/BS/STmin) */
 
+/* max. number of CFs sent at once (SN has to be unique for the echo tag) */
+#define ISOTP_TX_BATCH_MAX 16
+
 #define ISOTP_CHECK_PADDING (CAN_ISOTP_CHK_PAD_LEN | CAN_ISOTP_CHK_PAD_DATA)
 #define ISOTP_ALL_BC_FLAGS (CAN_ISOTP_SF_BROADCAST | CAN_ISOTP_CF_BROADCAST)
 
@@ -136,6 +139,7 @@ struct isotp_sock {
 	canid_t txid;
 	canid_t rxid;
 	ktime_t tx_gap;
+	u32 tx_stmin; /* N_Cs part of tx_gap in nano secs */
 	ktime_t lastrxcf_tstamp;
 	struct hrtimer rxtimer, txtimer;
 	struct can_isotp_options opt;
@@ -344,9 +348,32 @@ static int check_pad(struct isotp_sock *so, struct canfd_frame *cf,
 	return 0;
 }
 
+/* number of CFs to send at once in CAN_ISOTP_TX_BATCH mode, 0 if disabled */
+static unsigned int isotp_tx_batch(struct isotp_sock *so, int ae)
+{
+	unsigned int n;
+
+	if (!(so->opt.flags & CAN_ISOTP_TX_BATCH))
+		return 0;
+
+	/* STmin can only be honoured by the qdisc with SO_TXTIME */
+	if (so->tx_stmin && !sock_flag(&so->sk, SOCK_TXTIME))
+		return 0;
+
+	n = DIV_ROUND_UP(so->tx.len - so->tx.idx,
+			 so->tx.ll_dl - N_PCI_SZ - ae);
+	if (so->txfc.bs)
+		n = min_t(unsigned int, n, so->txfc.bs - so->tx.bs);
+
+	return min_t(unsigned int, n, ISOTP_TX_BATCH_MAX);
+}
+
+static void isotp_send_cframes(struct isotp_sock *so, unsigned int n);
+
 static int isotp_rcv_fc(struct isotp_sock *so, struct canfd_frame *cf, int ae)
 {
 	struct sock *sk = &so->sk;
+	unsigned int batch;
 
 	if (so->tx.state != ISOTP_WAIT_FC &&
 	    so->tx.state != ISOTP_WAIT_FIRST_FC)
@@ -377,20 +404,19 @@ static int isotp_rcv_fc(struct isotp_sock *so, struct canfd_frame *cf, int ae)
 		    (so->txfc.stmin < 0xF1 || so->txfc.stmin > 0xF9))
 			so->txfc.stmin = 0x7F;
 
+		/* waiting time for consecutive frames N_Cs */
+		if (so->opt.flags & CAN_ISOTP_FORCE_TXSTMIN)
+			so->tx_stmin = so->force_tx_stmin;
+		else if (so->txfc.stmin < 0x80)
+			so->tx_stmin = so->txfc.stmin * 1000000;
+		else
+			so->tx_stmin = (so->txfc.stmin - 0xF0) * 100000;
+
 		so->tx_gap = ktime_set(0, 0);
 		/* add transmission time for CAN frame N_As */
 		so->tx_gap = ktime_add_ns(so->tx_gap, so->frame_txtime);
 		/* add waiting time for consecutive frames N_Cs */
-		if (so->opt.flags & CAN_ISOTP_FORCE_TXSTMIN)
-			so->tx_gap = ktime_add_ns(so->tx_gap,
-						  so->force_tx_stmin);
-		else if (so->txfc.stmin < 0x80)
-			so->tx_gap = ktime_add_ns(so->tx_gap,
-						  so->txfc.stmin * 1000000);
-		else
-			so->tx_gap = ktime_add_ns(so->tx_gap,
-						  (so->txfc.stmin - 0xF0)
-						  * 100000);
+		so->tx_gap = ktime_add_ns(so->tx_gap, so->tx_stmin);
 		so->tx.state = ISOTP_WAIT_FC;
 	}
 
@@ -398,6 +424,16 @@ static int isotp_rcv_fc(struct isotp_sock *so, struct canfd_frame *cf, int ae)
 	case ISOTP_FC_CTS:
 		so->tx.bs = 0;
 		so->tx.state = ISOTP_SENDING;
+
+		batch = isotp_tx_batch(so, ae);
+		if (batch) {
+			/* start timeout for unlikely lost echo skb */
+			hrtimer_start(&so->txtimer, ktime_set(2, 0),
+				      HRTIMER_MODE_REL_SOFT);
+			isotp_send_cframes(so, batch);
+			break;
+		}
+
 		/* start cyclic timer for sending CF frame */
 		hrtimer_start(&so->txtimer, so->tx_gap,
 			      HRTIMER_MODE_REL_SOFT);
@@ -731,12 +767,29 @@ static void isotp_fill_dataframe(struct canfd_frame *cf, struct isotp_sock *so,
 		cf->data[0] = so->opt.ext_address;
 }
 
-static void isotp_send_cframe(struct isotp_sock *so)
+static ktime_t isotp_txtime_now(const struct sock *sk)
+{
+	switch (sk->sk_clockid) {
+	case CLOCK_REALTIME:
+		return ktime_get_real();
+	case CLOCK_TAI:
+		return ktime_get_clocktai();
+	case CLOCK_BOOTTIME:
+		return ktime_get_boottime();
+	default:
+		return ktime_get();
+	}
+}
+
+static void isotp_send_cframes(struct isotp_sock *so, unsigned int n)
 {
+	struct sk_buff *skbs[ISOTP_TX_BATCH_MAX];
 	struct sock *sk = &so->sk;
 	struct sk_buff *skb;
 	struct net_device *dev;
-	struct canfd_frame *cf;
+	struct canfd_frame *cf = NULL;
+	ktime_t txtime = 0;
+	unsigned int i;
 	int can_send_ret;
 	int ae = (so->opt.flags & CAN_ISOTP_EXTEND_ADDR) ? 1 : 0;
 
@@ -744,46 +797,79 @@ static void isotp_send_cframe(struct isotp_sock *so)
 	if (!dev)
 		return;
 
-	skb = alloc_skb(so->ll.mtu + sizeof(struct can_skb_priv), GFP_ATOMIC);
-	if (!skb) {
+	/* CAN netdevices default to a tx_queue_len of 10 */
+	n = min_t(unsigned int, n, max_t(unsigned int, dev->tx_queue_len, 1));
+
+	/* get all skbs before the tx state is advanced */
+	for (i = 0; i < n; i++) {
+		skbs[i] = alloc_skb(so->ll.mtu + sizeof(struct can_skb_priv),
+				    GFP_ATOMIC);
+		if (!skbs[i])
+			break;
+	}
+	n = i;
+	if (!n) {
 		dev_put(dev);
 		return;
 	}
 
-	can_skb_reserve(skb);
-	can_skb_prv(skb)->ifindex = dev->ifindex;
-	can_skb_prv(skb)->skbcnt = 0;
+	/* batched CFs leave the qdisc STmin apart from each other */
+	if ((so->opt.flags & CAN_ISOTP_TX_BATCH) && so->tx_stmin &&
+	    sock_flag(sk, SOCK_TXTIME))
+		txtime = isotp_txtime_now(sk);
 
-	cf = (struct canfd_frame *)skb->data;
-	skb_put_zero(skb, so->ll.mtu);
+	for (i = 0; i < n; i++) {
+		skb = skbs[i];
 
-	/* create consecutive frame */
-	isotp_fill_dataframe(cf, so, ae, 0);
+		can_skb_reserve(skb);
+		can_skb_prv(skb)->ifindex = dev->ifindex;
+		can_skb_prv(skb)->skbcnt = 0;
 
-	/* place consecutive frame N_PCI in appropriate index */
-	cf->data[ae] = N_PCI_CF | so->tx.sn++;
-	so->tx.sn %= 16;
-	so->tx.bs++;
+		cf = (struct canfd_frame *)skb->data;
+		skb_put_zero(skb, so->ll.mtu);
 
-	cf->flags = so->ll.tx_flags;
+		/* create consecutive frame */
+		isotp_fill_dataframe(cf, so, ae, 0);
 
-	skb->dev = dev;
-	can_skb_set_owner(skb, sk);
+		/* place consecutive frame N_PCI in appropriate index */
+		cf->data[ae] = N_PCI_CF | so->tx.sn++;
+		so->tx.sn %= 16;
+		so->tx.bs++;
+
+		cf->flags = so->ll.tx_flags;
+
+		skb->dev = dev;
+		can_skb_set_owner(skb, sk);
+
+		if (txtime) {
+			txtime = ktime_add_ns(txtime, so->tx_stmin);
+			skb_set_delivery_time(skb, txtime,
+					      sk->sk_clockid == CLOCK_MONOTONIC);
+		}
+	}
 
 	/* cfecho should have been zero'ed by init/isotp_rcv_echo() */
 	if (so->cfecho)
 		pr_notice_once("can-isotp: cfecho is %08X != 0\n", so->cfecho);
 
-	/* set consecutive frame echo tag */
+	/* set consecutive frame echo tag of the last frame in this batch
+	 * before any frame can be echoed
+	 */
 	so->cfecho = *(u32 *)cf->data;
 
-	/* send frame with local echo enabled */
-	can_send_ret = can_send(skb, 1);
-	if (can_send_ret) {
-		pr_notice_once("can-isotp: %s: can_send_ret %pe\n",
-			       __func__, ERR_PTR(can_send_ret));
-		if (can_send_ret == -ENOBUFS)
-			pr_notice_once("can-isotp: tx queue is full\n");
+	for (i = 0; i < n; i++) {
+		/* send frame with local echo enabled */
+		can_send_ret = can_send(skbs[i], 1);
+		if (can_send_ret) {
+			pr_notice_once("can-isotp: %s: can_send_ret %pe\n",
+				       __func__, ERR_PTR(can_send_ret));
+			if (can_send_ret == -ENOBUFS)
+				pr_notice_once("can-isotp: tx queue is full\n");
+
+			/* the echo tag is lost, the echo timeout reports it */
+			while (++i < n)
+				kfree_skb(skbs[i]);
+		}
 	}
 	dev_put(dev);
 }
@@ -828,6 +914,8 @@ static void isotp_rcv_echo(struct sk_buff *skb, void *data)
 	struct sock *sk = (struct sock *)data;
 	struct isotp_sock *so = isotp_sk(sk);
 	struct canfd_frame *cf = (struct canfd_frame *)skb->data;
+	int ae = (so->opt.flags & CAN_ISOTP_EXTEND_ADDR) ? 1 : 0;
+	unsigned int batch;
 
 	/* only handle my own local echo skb's */
 	if (skb->sk != sk || so->cfecho != *(u32 *)cf->data)
@@ -854,9 +942,18 @@ static void isotp_rcv_echo(struct sk_buff *skb, void *data)
 		return;
 	}
 
+	batch = isotp_tx_batch(so, ae);
+	if (batch) {
+		/* start timeout for unlikely lost echo skb */
+		hrtimer_start(&so->txtimer, ktime_set(2, 0),
+			      HRTIMER_MODE_REL_SOFT);
+		isotp_send_cframes(so, batch);
+		return;
+	}
+
 	/* no gap between data frames needed => use burst mode */
 	if (!so->tx_gap) {
-		isotp_send_cframe(so);
+		isotp_send_cframes(so, 1);
 		return;
 	}
 
@@ -883,7 +980,7 @@ static enum hrtimer_restart isotp_tx_timer_handler(struct hrtimer *hrtimer)
 			restart = HRTIMER_RESTART;
 
 			/* push out the next consecutive frame */
-			isotp_send_cframe(so);
+			isotp_send_cframes(so, 1);
 			break;
 		}
 
@@ -1023,10 +1120,13 @@ static int isotp_sendmsg(struct socket *sock, struct msghdr *msg, size_t size)
 
 		if (isotp_bc_flags(so) == CAN_ISOTP_CF_BROADCAST) {
 			/* set timer for FC-less operation (STmin = 0) */
-			if (so->opt.flags & CAN_ISOTP_FORCE_TXSTMIN)
+			if (so->opt.flags & CAN_ISOTP_FORCE_TXSTMIN) {
+				so->tx_stmin = so->force_tx_stmin;
 				so->tx_gap = ktime_set(0, so->force_tx_stmin);
-			else
+			} else {
+				so->tx_stmin = 0;
 				so->tx_gap = ktime_set(0, so->frame_txtime);
+			}
 
 			/* disable wait for FCs due to activated block size */
 			so->txfc.bs = 0;
@@ -24,6 +24,7 @@
 #include <linux/percpu.h>
 #include <linux/timer.h>
 #include <linux/bitops.h>
+#include <linux/jhash.h>
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <net/genetlink.h>
@@ -61,6 +62,23 @@ struct net_dm_stats {
 
 #define NET_DM_MAX_HW_TRAP_NAME_LEN 40
 
+/* Per-CPU table used in aggregate mode. An entry is free while its count
+ * is zero and is looked up with bounded linear probing, drops which do
+ * not find a slot are accounted in the 'dropped' statistic instead.
+ */
+#define NET_DM_AGGR_BITS	8
+#define NET_DM_AGGR_SIZE	(1 << NET_DM_AGGR_BITS)
+#define NET_DM_AGGR_PROBES	8
+/* Capacity of the table the per-CPU tables are merged into */
+#define NET_DM_AGGR_MERGE_SIZE	(4 * NET_DM_AGGR_SIZE)
+
+struct net_dm_aggr_entry {
+	u16 reason;
+	__be16 proto;
+	int ifindex;
+	u64 count;
+};
+
 struct net_dm_hw_entry {
 	char trap_name[NET_DM_MAX_HW_TRAP_NAME_LEN];
 	u32 count;
@@ -72,13 +90,15 @@ struct net_dm_hw_entries {
 };
 
 struct per_cpu_dm_data {
-	spinlock_t		lock;	/* Protects 'skb', 'hw_entries' and
-					 * 'send_timer'
+	spinlock_t		lock;	/* Protects 'skb', 'hw_entries',
+					 * 'aggr' and 'send_timer'
 					 */
 	union {
 		struct sk_buff			*skb;
 		struct net_dm_hw_entries	*hw_entries;
 	};
+	struct net_dm_aggr_entry *aggr;
+	u32			aggr_skip;
 	struct sk_buff_head	drop_queue;
 	struct work_struct	dm_alert_work;
 	struct timer_list	send_timer;
@@ -103,6 +123,7 @@ static unsigned long dm_hw_check_delta = 2*HZ;
 static enum net_dm_alert_mode net_dm_alert_mode = NET_DM_ALERT_MODE_SUMMARY;
 static u32 net_dm_trunc_len;
 static u32 net_dm_queue_len = 1000;
+static u32 net_dm_sample_rate = 1;
 
 struct net_dm_alert_ops {
 	void (*kfree_skb_probe)(void *ignore, struct sk_buff *skb,
@@ -1001,9 +1022,86 @@ static const struct net_dm_alert_ops net_dm_alert_packet_ops = {
 	.hw_trap_probe		= net_dm_hw_trap_packet_probe,
 };
 
+static u32 net_dm_aggr_hash(const struct net_dm_aggr_entry *key)
+{
+	return jhash_3words(key->reason, (__force u32)key->proto,
+			    key->ifindex, 0);
+}
+
+static bool net_dm_aggr_match(const struct net_dm_aggr_entry *entry,
+			      const struct net_dm_aggr_entry *key)
+{
+	return entry->reason == key->reason && entry->proto == key->proto &&
+	       entry->ifindex == key->ifindex;
+}
+
+static void net_dm_aggr_trace_kfree_skb_hit(void *ignore,
+					    struct sk_buff *skb,
+					    void *location,
+					    enum skb_drop_reason reason)
+{
+	struct net_dm_aggr_entry key, *entry;
+	struct per_cpu_dm_data *data;
+	unsigned long flags;
+	u32 hash, i;
+
+	local_irq_save(flags);
+	data = this_cpu_ptr(&dm_cpu_data);
+
+	/* Only one in 'net_dm_sample_rate' drops is counted */
+	if (data->aggr_skip) {
+		data->aggr_skip--;
+		local_irq_restore(flags);
+		return;
+	}
+	data->aggr_skip = net_dm_sample_rate - 1;
+
+	if (unlikely(reason >= SKB_DROP_REASON_MAX || reason <= 0))
+		reason = SKB_DROP_REASON_NOT_SPECIFIED;
+	key.reason = reason;
+	key.proto = skb->protocol;
+	key.ifindex = skb->skb_iif;
+	hash = net_dm_aggr_hash(&key);
+
+	spin_lock(&data->lock);
+	if (!data->aggr)
+		goto out;
+
+	for (i = 0; i < NET_DM_AGGR_PROBES; i++) {
+		entry = &data->aggr[(hash + i) & (NET_DM_AGGR_SIZE - 1)];
+		if (!entry->count) {
+			*entry = key;
+			entry->count = 1;
+			goto out;
+		}
+		if (net_dm_aggr_match(entry, &key)) {
+			entry->count++;
+			goto out;
+		}
+	}
+
+	u64_stats_update_begin(&data->stats.syncp);
+	u64_stats_inc(&data->stats.dropped);
+	u64_stats_update_end(&data->stats.syncp);
+out:
+	spin_unlock_irqrestore(&data->lock, flags);
+}
+
+/* Hardware drops are still reported as summaries in aggregate mode. The
+ * software alert work is never queued.
+ */
+static const struct net_dm_alert_ops net_dm_alert_aggr_ops = {
+	.kfree_skb_probe	= net_dm_aggr_trace_kfree_skb_hit,
+	.napi_poll_probe	= net_dm_packet_trace_napi_poll_hit,
+	.work_item_func		= send_dm_alert,
+	.hw_work_item_func	= net_dm_hw_summary_work,
+	.hw_trap_probe		= net_dm_hw_trap_summary_probe,
+};
+
 static const struct net_dm_alert_ops *net_dm_alert_ops_arr[] = {
 	[NET_DM_ALERT_MODE_SUMMARY]	= &net_dm_alert_summary_ops,
 	[NET_DM_ALERT_MODE_PACKET]	= &net_dm_alert_packet_ops,
+	[NET_DM_ALERT_MODE_AGGREGATE]	= &net_dm_alert_aggr_ops,
 };
 
 #if IS_ENABLED(CONFIG_NET_DEVLINK)
@@ -1118,6 +1216,34 @@ static void net_dm_hw_monitor_stop(struct netlink_ext_ack *extack)
 	module_put(THIS_MODULE);
 }
 
+/* Start every aggregation run with empty tables. Tables are kept after
+ * tracing is stopped so that the final counts can still be read.
+ */
+static int net_dm_aggr_reset_all(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct per_cpu_dm_data *data = &per_cpu(dm_cpu_data, cpu);
+		struct net_dm_aggr_entry *aggr;
+		unsigned long flags;
+
+		aggr = kcalloc_node(NET_DM_AGGR_SIZE, sizeof(*aggr),
+				    GFP_KERNEL, cpu_to_node(cpu));
+		if (!aggr)
+			return -ENOMEM;
+
+		spin_lock_irqsave(&data->lock, flags);
+		swap(data->aggr, aggr);
+		data->aggr_skip = 0;
+		spin_unlock_irqrestore(&data->lock, flags);
+
+		kfree(aggr);
+	}
+
+	return 0;
+}
+
 static int net_dm_trace_on_set(struct netlink_ext_ack *extack)
 {
 	const struct net_dm_alert_ops *ops;
@@ -1125,6 +1251,12 @@ static int net_dm_trace_on_set(struct netlink_ext_ack *extack)
 
 	ops = net_dm_alert_ops_arr[net_dm_alert_mode];
 
+	if (net_dm_alert_mode == NET_DM_ALERT_MODE_AGGREGATE &&
+	    net_dm_aggr_reset_all()) {
+		NL_SET_ERR_MSG_MOD(extack, "Failed to allocate aggregation tables");
+		return -ENOMEM;
+	}
+
 	if (!try_module_get(THIS_MODULE)) {
 		NL_SET_ERR_MSG_MOD(extack, "Failed to take reference on module");
 		return -ENODEV;
@@ -1246,6 +1378,7 @@ static int net_dm_alert_mode_get_from_info(struct genl_info *info,
 	switch (val) {
 	case NET_DM_ALERT_MODE_SUMMARY:
 	case NET_DM_ALERT_MODE_PACKET:
+	case NET_DM_ALERT_MODE_AGGREGATE:
 		*p_alert_mode = val;
 		break;
 	default:
@@ -1291,6 +1424,14 @@ static void net_dm_queue_len_set(struct genl_info *info)
 	net_dm_queue_len = nla_get_u32(info->attrs[NET_DM_ATTR_QUEUE_LEN]);
 }
 
+static void net_dm_sample_rate_set(struct genl_info *info)
+{
+	if (!info->attrs[NET_DM_ATTR_SAMPLE_RATE])
+		return;
+
+	net_dm_sample_rate = nla_get_u32(info->attrs[NET_DM_ATTR_SAMPLE_RATE]);
+}
+
 static int net_dm_cmd_config(struct sk_buff *skb,
 			struct genl_info *info)
 {
@@ -1310,6 +1451,8 @@ static int net_dm_cmd_config(struct sk_buff *skb,
 
 	net_dm_queue_len_set(info);
 
+	net_dm_sample_rate_set(info);
+
 	return 0;
 }
 
@@ -1391,6 +1534,9 @@ static int net_dm_config_fill(struct sk_buff *msg, struct genl_info *info)
 	if (nla_put_u32(msg, NET_DM_ATTR_QUEUE_LEN, net_dm_queue_len))
 		goto nla_put_failure;
 
+	if (nla_put_u32(msg, NET_DM_ATTR_SAMPLE_RATE, net_dm_sample_rate))
+		goto nla_put_failure;
+
 	genlmsg_end(msg, hdr);
 
 	return 0;
@@ -1440,7 +1586,8 @@ static void net_dm_stats_read(struct net_dm_stats *stats)
 	}
 }
 
-static int net_dm_stats_put(struct sk_buff *msg)
+/* 'extra' accounts for drops only lost from the reply being built */
+static int net_dm_stats_put(struct sk_buff *msg, u64 extra)
 {
 	struct net_dm_stats stats;
 	struct nlattr *attr;
@@ -1452,7 +1599,8 @@ static int net_dm_stats_put(struct sk_buff *msg)
 		return -EMSGSIZE;
 
 	if (nla_put_u64_64bit(msg, NET_DM_ATTR_STATS_DROPPED,
-			      u64_stats_read(&stats.dropped), NET_DM_ATTR_PAD))
+			      u64_stats_read(&stats.dropped) + extra,
+			      NET_DM_ATTR_PAD))
 		goto nla_put_failure;
 
 	nla_nest_end(msg, attr);
@@ -1518,7 +1666,7 @@ static int net_dm_stats_fill(struct sk_buff *msg, struct genl_info *info)
 	if (!hdr)
 		return -EMSGSIZE;
 
-	rc = net_dm_stats_put(msg);
+	rc = net_dm_stats_put(msg, 0);
 	if (rc)
 		goto nla_put_failure;
 
@@ -1555,6 +1703,211 @@ static int net_dm_cmd_stats_get(struct sk_buff *skb, struct genl_info *info)
 	return rc;
 }
 
+/* Fold the per-CPU tables into 'merged', optionally clearing them. Returns
+ * the number of drops which did not fit in 'merged'.
+ */
+static u64 net_dm_aggr_merge(struct net_dm_aggr_entry *merged, bool reset)
+{
+	u64 overflow = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct per_cpu_dm_data *data = &per_cpu(dm_cpu_data, cpu);
+		unsigned long flags;
+		int i;
+
+		spin_lock_irqsave(&data->lock, flags);
+		if (!data->aggr)
+			goto unlock;
+
+		for (i = 0; i < NET_DM_AGGR_SIZE; i++) {
+			const struct net_dm_aggr_entry *entry = &data->aggr[i];
+			u32 hash, j;
+
+			if (!entry->count)
+				continue;
+
+			hash = net_dm_aggr_hash(entry);
+			for (j = 0; j < NET_DM_AGGR_MERGE_SIZE; j++) {
+				struct net_dm_aggr_entry *m;
+
+				m = &merged[(hash + j) &
+					    (NET_DM_AGGR_MERGE_SIZE - 1)];
+				if (!m->count) {
+					*m = *entry;
+					break;
+				}
+				if (net_dm_aggr_match(m, entry)) {
+					m->count += entry->count;
+					break;
+				}
+			}
+			if (j == NET_DM_AGGR_MERGE_SIZE)
+				overflow += entry->count;
+		}
+
+		if (reset)
+			memset(data->aggr, 0,
+			       NET_DM_AGGR_SIZE * sizeof(*data->aggr));
+unlock:
+		spin_unlock_irqrestore(&data->lock, flags);
+	}
+
+	return overflow;
+}
+
+static size_t net_dm_aggr_entry_size(const struct net_dm_aggr_entry *entry)
+{
+	       /* NET_DM_ATTR_AGGR_ENTRY nest */
+	return nla_total_size(0) +
+	       /* NET_DM_ATTR_REASON */
+	       nla_total_size(strlen(drop_reasons[entry->reason]) + 1) +
+	       /* NET_DM_ATTR_IN_PORT */
+	       net_dm_in_port_size() +
+	       /* NET_DM_ATTR_PROTO */
+	       nla_total_size(sizeof(u16)) +
+	       /* NET_DM_ATTR_AGGR_COUNT */
+	       nla_total_size_64bit(sizeof(u64));
+}
+
+static int net_dm_aggr_entry_put(struct sk_buff *msg,
+				 const struct net_dm_aggr_entry *entry)
+{
+	struct nlattr *attr;
+
+	attr = nla_nest_start(msg, NET_DM_ATTR_AGGR_ENTRY);
+	if (!attr)
+		return -EMSGSIZE;
+
+	if (nla_put_string(msg, NET_DM_ATTR_REASON,
+			   drop_reasons[entry->reason]))
+		goto nla_put_failure;
+
+	if (net_dm_packet_report_in_port_put(msg, entry->ifindex, NULL))
+		goto nla_put_failure;
+
+	if (nla_put_u16(msg, NET_DM_ATTR_PROTO, be16_to_cpu(entry->proto)))
+		goto nla_put_failure;
+
+	if (nla_put_u64_64bit(msg, NET_DM_ATTR_AGGR_COUNT, entry->count,
+			      NET_DM_ATTR_PAD))
+		goto nla_put_failure;
+
+	nla_nest_end(msg, attr);
+
+	return 0;
+
+nla_put_failure:
+	nla_nest_cancel(msg, attr);
+	return -EMSGSIZE;
+}
+
+static int net_dm_aggr_fill(struct sk_buff *msg, struct genl_info *info,
+			    const struct net_dm_aggr_entry *merged,
+			    u64 overflow)
+{
+	struct nlattr *attr;
+	void *hdr;
+	int i;
+
+	hdr = genlmsg_put(msg, info->snd_portid, info->snd_seq,
+			  &net_drop_monitor_family, 0, NET_DM_CMD_AGGR_NEW);
+	if (!hdr)
+		return -EMSGSIZE;
+
+	if (nla_put_u32(msg, NET_DM_ATTR_SAMPLE_RATE, net_dm_sample_rate))
+		goto nla_put_failure;
+
+	attr = nla_nest_start(msg, NET_DM_ATTR_AGGR_ENTRIES);
+	if (!attr)
+		goto nla_put_failure;
+
+	for (i = 0; i < NET_DM_AGGR_MERGE_SIZE; i++) {
+		if (!merged[i].count)
+			continue;
+		if (net_dm_aggr_entry_put(msg, &merged[i]))
+			goto nla_put_failure;
+	}
+
+	nla_nest_end(msg, attr);
+
+	if (net_dm_stats_put(msg, overflow))
+		goto nla_put_failure;
+
+	genlmsg_end(msg, hdr);
+
+	return 0;
+
+nla_put_failure:
+	genlmsg_cancel(msg, hdr);
+	return -EMSGSIZE;
+}
+
+/* Reply with a snapshot of the aggregated counters of all CPUs. Counts are
+ * in sampled drops and have to be scaled by NET_DM_ATTR_SAMPLE_RATE.
+ */
+static int net_dm_cmd_aggr_get(struct sk_buff *skb, struct genl_info *info)
+{
+	bool reset = !!info->attrs[NET_DM_ATTR_AGGR_RESET];
+	struct net_dm_aggr_entry *merged;
+	struct net_dm_stats *stats;
+	struct sk_buff *msg;
+	size_t size;
+	u64 overflow;
+	int i, rc;
+
+	if (reset && !netlink_capable(skb, CAP_NET_ADMIN)) {
+		NL_SET_ERR_MSG_MOD(info->extack, "Resetting counters requires CAP_NET_ADMIN");
+		return -EPERM;
+	}
+
+	merged = kvcalloc(NET_DM_AGGR_MERGE_SIZE, sizeof(*merged), GFP_KERNEL);
+	if (!merged)
+		return -ENOMEM;
+
+	/* Without a reset the overflowed drops stay in the per-CPU tables and
+	 * would be counted again by the next snapshot, so only report them in
+	 * this reply. With a reset they are gone for good.
+	 */
+	overflow = net_dm_aggr_merge(merged, reset);
+	if (overflow && reset) {
+		unsigned long flags;
+
+		/* the probe updates the same counter from any context */
+		local_irq_save(flags);
+		stats = this_cpu_ptr(&dm_cpu_data.stats);
+		u64_stats_update_begin(&stats->syncp);
+		u64_stats_add(&stats->dropped, overflow);
+		u64_stats_update_end(&stats->syncp);
+		local_irq_restore(flags);
+		overflow = 0;
+	}
+
+	size = NLMSG_DEFAULT_SIZE;
+	for (i = 0; i < NET_DM_AGGR_MERGE_SIZE; i++)
+		if (merged[i].count)
+			size += net_dm_aggr_entry_size(&merged[i]);
+
+	msg = genlmsg_new(size, GFP_KERNEL);
+	if (!msg) {
+		rc = -ENOMEM;
+		goto free_merged;
+	}
+
+	rc = net_dm_aggr_fill(msg, info, merged, overflow);
+	if (rc)
+		goto free_msg;
+
+	kvfree(merged);
+	return genlmsg_reply(msg, info);
+
+free_msg:
+	nlmsg_free(msg);
+free_merged:
+	kvfree(merged);
+	return rc;
+}
+
 static int dropmon_net_event(struct notifier_block *ev_block,
 			     unsigned long event, void *ptr)
 {
@@ -1591,6 +1944,8 @@ static const struct nla_policy net_dm_nl_policy[NET_DM_ATTR_MAX + 1] = {
 	[NET_DM_ATTR_QUEUE_LEN] = { .type = NLA_U32 },
 	[NET_DM_ATTR_SW_DROPS]	= {. type = NLA_FLAG },
 	[NET_DM_ATTR_HW_DROPS]	= {. type = NLA_FLAG },
+	[NET_DM_ATTR_SAMPLE_RATE] = NLA_POLICY_MIN(NLA_U32, 1),
+	[NET_DM_ATTR_AGGR_RESET] = { .type = NLA_FLAG },
 };
 
 static const struct genl_small_ops dropmon_ops[] = {
@@ -1618,6 +1973,10 @@ static const struct genl_small_ops dropmon_ops[] = {
 		.cmd = NET_DM_CMD_STATS_GET,
 		.doit = net_dm_cmd_stats_get,
 	},
+	{
+		.cmd = NET_DM_CMD_AGGR_GET,
+		.doit = net_dm_cmd_aggr_get,
+	},
 };
 
 static int net_dm_nl_pre_doit(const struct genl_ops *ops,
@@ -1682,6 +2041,7 @@ static void net_dm_cpu_data_fini(int cpu)
 	 * to this struct and can free the skb inside it.
 	 */
 	consume_skb(data->skb);
+	kfree(data->aggr);
 	__net_dm_cpu_data_fini(data);
 }
 
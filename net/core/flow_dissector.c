@@ -895,6 +895,136 @@ bool bpf_flow_dissect(struct bpf_prog *prog, struct bpf_flow_dissector *ctx,
 	return result == BPF_OK;
 }
 
+/* Keys which __skb_flow_dissect() leaves alone for TCP and UDP over
+ * IPv4 or IPv6 without VLAN tags, extension headers or fragments.
+ */
+#define FLOW_DISSECTOR_FAST_KEYS	(BIT(FLOW_DISSECTOR_KEY_CONTROL) |	\
+					 BIT(FLOW_DISSECTOR_KEY_BASIC) |	\
+					 BIT(FLOW_DISSECTOR_KEY_IPV4_ADDRS) |	\
+					 BIT(FLOW_DISSECTOR_KEY_IPV6_ADDRS) |	\
+					 BIT(FLOW_DISSECTOR_KEY_PORTS) |	\
+					 BIT(FLOW_DISSECTOR_KEY_PORTS_RANGE) |	\
+					 BIT(FLOW_DISSECTOR_KEY_ICMP) |		\
+					 BIT(FLOW_DISSECTOR_KEY_TIPC) |		\
+					 BIT(FLOW_DISSECTOR_KEY_ARP) |		\
+					 BIT(FLOW_DISSECTOR_KEY_VLAN) |		\
+					 BIT(FLOW_DISSECTOR_KEY_CVLAN) |	\
+					 BIT(FLOW_DISSECTOR_KEY_FLOW_LABEL) |	\
+					 BIT(FLOW_DISSECTOR_KEY_GRE_KEYID) |	\
+					 BIT(FLOW_DISSECTOR_KEY_MPLS_ENTROPY) |	\
+					 BIT(FLOW_DISSECTOR_KEY_MPLS) |		\
+					 BIT(FLOW_DISSECTOR_KEY_PPPOE))
+
+/* Dissect the common case of a TCP or UDP packet directly on top of IPv4 or
+ * IPv6, producing the same keys as the generic parser. Returns false if
+ * the packet needs the generic parser.
+ */
+static bool __skb_flow_dissect_fast(const struct sk_buff *skb,
+				    struct flow_dissector *flow_dissector,
+				    void *target_container, const void *data,
+				    __be16 proto, int nhoff, int hlen,
+				    unsigned int flags)
+{
+	struct flow_dissector_key_control *key_control;
+	struct flow_dissector_key_basic *key_basic;
+	struct flow_dissector_key_addrs *key_addrs;
+	struct flow_dissector_key_tags *key_tags;
+	u8 ip_proto;
+
+	key_control = skb_flow_dissector_target(flow_dissector,
+						FLOW_DISSECTOR_KEY_CONTROL,
+						target_container);
+
+	switch (proto) {
+	case htons(ETH_P_IP): {
+		const struct iphdr *iph;
+		struct iphdr _iph;
+
+		iph = __skb_header_pointer(skb, nhoff, sizeof(_iph), data, hlen, &_iph);
+		if (!iph || iph->ihl < 5 || ip_is_fragment(iph))
+			return false;
+
+		ip_proto = iph->protocol;
+		if (ip_proto != IPPROTO_TCP && ip_proto != IPPROTO_UDP)
+			return false;
+
+		nhoff += iph->ihl * 4;
+
+		if (dissector_uses_key(flow_dissector,
+				       FLOW_DISSECTOR_KEY_IPV4_ADDRS)) {
+			key_addrs = skb_flow_dissector_target(flow_dissector,
+							      FLOW_DISSECTOR_KEY_IPV4_ADDRS,
+							      target_container);
+
+			memcpy(&key_addrs->v4addrs.src, &iph->saddr,
+			       sizeof(key_addrs->v4addrs.src));
+			memcpy(&key_addrs->v4addrs.dst, &iph->daddr,
+			       sizeof(key_addrs->v4addrs.dst));
+			key_control->addr_type = FLOW_DISSECTOR_KEY_IPV4_ADDRS;
+		}
+		break;
+	}
+	case htons(ETH_P_IPV6): {
+		const struct ipv6hdr *iph;
+		struct ipv6hdr _iph;
+		__be32 flow_label;
+
+		iph = __skb_header_pointer(skb, nhoff, sizeof(_iph), data, hlen, &_iph);
+		if (!iph)
+			return false;
+
+		ip_proto = iph->nexthdr;
+		if (ip_proto != IPPROTO_TCP && ip_proto != IPPROTO_UDP)
+			return false;
+
+		nhoff += sizeof(struct ipv6hdr);
+
+		if (dissector_uses_key(flow_dissector,
+				       FLOW_DISSECTOR_KEY_IPV6_ADDRS)) {
+			key_addrs = skb_flow_dissector_target(flow_dissector,
+							      FLOW_DISSECTOR_KEY_IPV6_ADDRS,
+							      target_container);
+
+			memcpy(&key_addrs->v6addrs.src, &iph->saddr,
+			       sizeof(key_addrs->v6addrs.src));
+			memcpy(&key_addrs->v6addrs.dst, &iph->daddr,
+			       sizeof(key_addrs->v6addrs.dst));
+			key_control->addr_type = FLOW_DISSECTOR_KEY_IPV6_ADDRS;
+		}
+
+		flow_label = ip6_flowlabel(iph);
+		if (flow_label) {
+			if (dissector_uses_key(flow_dissector,
+					       FLOW_DISSECTOR_KEY_FLOW_LABEL)) {
+				key_tags = skb_flow_dissector_target(flow_dissector,
+								     FLOW_DISSECTOR_KEY_FLOW_LABEL,
+								     target_container);
+				key_tags->flow_label = ntohl(flow_label);
+			}
+			if (flags & FLOW_DISSECTOR_F_STOP_AT_FLOW_LABEL)
+				goto out;
+		}
+		break;
+	}
+	default:
+		return false;
+	}
+
+	__skb_flow_dissect_ports(skb, flow_dissector, target_container,
+				 data, nhoff, ip_proto, hlen);
+
+out:
+	key_basic = skb_flow_dissector_target(flow_dissector,
+					      FLOW_DISSECTOR_KEY_BASIC,
+					      target_container);
+
+	key_control->thoff = min_t(u16, nhoff, skb ? skb->len : hlen);
+	key_basic->n_proto = proto;
+	key_basic->ip_proto = ip_proto;
+
+	return true;
+}
+
 static bool is_pppoe_ses_hdr_valid(const struct pppoe_hdr *hdr)
 {
 	return hdr->ver == 1 && hdr->type == 1 && hdr->code == 0;
@@ -1029,6 +1159,11 @@ bool __skb_flow_dissect(const struct net *net,
 		rcu_read_unlock();
 	}
 
+	if (!(flow_dissector->used_keys & ~FLOW_DISSECTOR_FAST_KEYS) &&
+	    __skb_flow_dissect_fast(skb, flow_dissector, target_container,
+				    data, proto, nhoff, hlen, flags))
+		return true;
+
 	if (dissector_uses_key(flow_dissector,
 			       FLOW_DISSECTOR_KEY_ETH_ADDRS)) {
 		struct ethhdr *eth = eth_hdr(skb);
@@ -2,6 +2,7 @@
 #include <net/gro.h>
 #include <net/dst_metadata.h>
 #include <net/busy_poll.h>
+#include <linux/hash.h>
 #include <trace/events/net.h>
 
 #define MAX_GRO_SKBS 8
@@ -468,9 +469,30 @@ static void gro_flush_oldest(struct napi_struct *napi, struct list_head *head)
 	napi_gro_complete(napi, oldest);
 }
 
+/* Flows are kept apart by their hash, both to pick a bucket and in
+ * gro_list_prepare(). Devices not reporting a receive hash would put every
+ * flow in the same bucket, so that each packet is compared against all the
+ * held ones, and at most MAX_GRO_SKBS flows can be coalesced at a time: get
+ * a software hash for those, which RPS and RFS would compute later anyway.
+ *
+ * Use the upper bits of the hash, as the lower ones select the receive
+ * queue with RSS and are mostly the same for all the flows of a NAPI.
+ */
+static u32 gro_hash_bucket(struct sk_buff *skb)
+{
+	u32 hash = skb_get_hash_raw(skb);
+
+	if (unlikely(!hash) && !netif_elide_gro(skb->dev)) {
+		skb_set_network_header(skb, skb_gro_offset(skb));
+		hash = skb_get_hash(skb);
+	}
+
+	return hash_32(hash, GRO_HASH_BITS);
+}
+
 static enum gro_result dev_gro_receive(struct napi_struct *napi, struct sk_buff *skb)
 {
-	u32 bucket = skb_get_hash_raw(skb) & (GRO_HASH_BUCKETS - 1);
+	u32 bucket = gro_hash_bucket(skb);
 	struct gro_list *gro_list = &napi->gro_hash[bucket];
 	struct list_head *head = &offload_base;
 	struct packet_offload *ptype;
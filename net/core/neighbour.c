@@ -633,6 +633,20 @@ ___neigh_create(struct neigh_table *tbl, const void *pkey,
 	struct neigh_hash_table *nht;
 	int error;
 
+	/* Most callers race to resolve an entry that another CPU has just
+	 * inserted, find it under RCU before paying for an allocation and
+	 * the table lock. Entries unlinked by a flush can still be found
+	 * here, leave those to the slow path.
+	 */
+	rcu_read_lock_bh();
+	n1 = __neigh_lookup_noref(tbl, pkey, dev);
+	if (n1 && !READ_ONCE(n1->dead) &&
+	    (!want_ref || refcount_inc_not_zero(&n1->refcnt))) {
+		rcu_read_unlock_bh();
+		return n1;
+	}
+	rcu_read_unlock_bh();
+
 	n = neigh_alloc(tbl, dev, flags, exempt_from_gc);
 	trace_neigh_create(tbl, dev, pkey, n, exempt_from_gc);
 	if (!n) {
@@ -931,19 +945,45 @@ static void neigh_connect(struct neighbour *neigh)
 	neigh->output = neigh->ops->connected_output;
 }
 
+/* Number of gc_list entries looked at before the table lock is dropped. */
+#define NEIGH_GC_BATCH	256
+
+static void neigh_periodic_gc_one(struct neigh_table *tbl, struct neighbour *n)
+{
+	unsigned int state;
+	bool remove = false;
+
+	write_lock(&n->lock);
+
+	state = n->nud_state;
+	if ((state & (NUD_PERMANENT | NUD_IN_TIMER)) ||
+	    (n->flags & NTF_EXT_LEARNED)) {
+		write_unlock(&n->lock);
+		return;
+	}
+
+	if (time_before(n->used, n->confirmed))
+		n->used = n->confirmed;
+
+	if (refcount_read(&n->refcnt) == 1 &&
+	    (state == NUD_FAILED ||
+	     time_after(jiffies, n->used + NEIGH_VAR(n->parms, GC_STALETIME))))
+		remove = true;
+	write_unlock(&n->lock);
+
+	if (remove)
+		neigh_remove_one(n, tbl);
+}
+
 static void neigh_periodic_work(struct work_struct *work)
 {
 	struct neigh_table *tbl = container_of(work, struct neigh_table, gc_work.work);
+	unsigned int budget, batch;
 	struct neighbour *n;
-	struct neighbour __rcu **np;
-	unsigned int i;
-	struct neigh_hash_table *nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
 
 	write_lock_bh(&tbl->lock);
-	nht = rcu_dereference_protected(tbl->nht,
-					lockdep_is_held(&tbl->lock));
 
 	/*
 	 *	periodically recompute ReachableTime from random function
@@ -960,51 +1000,28 @@ static void neigh_periodic_work(struct work_struct *work)
 	if (atomic_read(&tbl->entries) < tbl->gc_thresh1)
 		goto out;
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
-		np = &nht->hash_buckets[i];
-
-		while ((n = rcu_dereference_protected(*np,
-				lockdep_is_held(&tbl->lock))) != NULL) {
-			unsigned int state;
-
-			write_lock(&n->lock);
-
-			state = n->nud_state;
-			if ((state & (NUD_PERMANENT | NUD_IN_TIMER)) ||
-			    (n->flags & NTF_EXT_LEARNED)) {
-				write_unlock(&n->lock);
-				goto next_elt;
-			}
-
-			if (time_before(n->used, n->confirmed))
-				n->used = n->confirmed;
-
-			if (refcount_read(&n->refcnt) == 1 &&
-			    (state == NUD_FAILED ||
-			     time_after(jiffies, n->used + NEIGH_VAR(n->parms, GC_STALETIME)))) {
-				*np = n->next;
-				neigh_mark_dead(n);
-				write_unlock(&n->lock);
-				neigh_cleanup_and_release(n);
-				continue;
-			}
-			write_unlock(&n->lock);
+	/* Entries exempt from gc never sit on gc_list, so walk it instead of
+	 * the whole hash. Visited entries are rotated to the tail, which lets
+	 * us drop the lock between batches and still see each entry once.
+	 */
+	budget = atomic_read(&tbl->gc_entries);
+	while (budget) {
+		for (batch = NEIGH_GC_BATCH; batch && budget; batch--, budget--) {
+			n = list_first_entry_or_null(&tbl->gc_list,
+						     struct neighbour, gc_list);
+			if (!n)
+				goto out;
 
-next_elt:
-			np = &n->next;
+			list_move_tail(&n->gc_list, &tbl->gc_list);
+			neigh_periodic_gc_one(tbl, n);
 		}
-		/*
-		 * It's fine to release lock here, even if hash table
-		 * grows while we are preempted.
-		 */
+
 		write_unlock_bh(&tbl->lock);
 		cond_resched();
 		write_lock_bh(&tbl->lock);
-		nht = rcu_dereference_protected(tbl->nht,
-						lockdep_is_held(&tbl->lock));
 	}
 out:
-	/* Cycle through all hash buckets every BASE_REACHABLE_TIME/2 ticks.
+	/* Cycle through all gc entries every BASE_REACHABLE_TIME/2 ticks.
 	 * ARP entry timeouts range from 1/2 BASE_REACHABLE_TIME to 3/2
 	 * BASE_REACHABLE_TIME.
 	 */
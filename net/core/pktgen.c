@@ -158,6 +158,7 @@
 #include <net/udp.h>
 #include <net/ip6_checksum.h>
 #include <net/addrconf.h>
+#include <net/xdp.h>
 #ifdef CONFIG_XFRM
 #include <net/xfrm.h>
 #endif
@@ -171,13 +172,19 @@
 #include <asm/dma.h>
 #include <asm/div64.h>		/* do_div */
 
-#define VERSION	"2.75"
+#define VERSION	"2.76"
 #define IP_NAME_SZ 32
 #define MAX_MPLS_LABELS 16 /* This is the max label stack depth */
 #define MPLS_STACK_BOTTOM htonl(0x00000100)
 /* Max number of internet mix entries that can be specified in imix_weights. */
 #define MAX_IMIX_ENTRIES 20
 #define IMIX_PRECISION 100 /* Precision of IMIX distribution */
+/* Max number of flow templates that can be specified in flow_tmpl. */
+#define MAX_FLOW_TMPLS 64
+/* Frames kept per device in xdp_xmit mode, recycled once the driver is done */
+#define PKTGEN_XDP_POOL 512
+#define PKTGEN_XDP_MAX_LEN (PAGE_SIZE - XDP_PACKET_HEADROOM - \
+			    SKB_DATA_ALIGN(sizeof(struct skb_shared_info)))
 
 #define func_enter() pr_debug("entering %s\n", __func__);
 
@@ -230,6 +237,7 @@ static char *pkt_flag_names[] = {
 #define M_START_XMIT		0	/* Default normal TX */
 #define M_NETIF_RECEIVE 	1	/* Inject packets into stack */
 #define M_QUEUE_XMIT		2	/* Inject packet into qdisc */
+#define M_XDP_XMIT		3	/* Send xdp_frames via ndo_xdp_xmit */
 
 /* If lock -- protects updating of if_list */
 #define   if_lock(t)           mutex_lock(&(t->if_lock));
@@ -251,6 +259,22 @@ struct imix_pkt {
 	u64 count_so_far;
 };
 
+struct flow_tmpl {
+	__be32 saddr;
+	__be32 daddr;
+	__u16 udp_src;
+	__u16 udp_dst;
+	u32 weight;
+	u32 cum_weight;		/* sum of the weights up to this one */
+	u64 count_so_far;
+};
+
+struct pktgen_xdp_slot {
+	struct page *page;	/* holds the xdp_frame and the packet */
+	unsigned int len;
+	unsigned int uses;	/* sent since the packet was built */
+};
+
 struct flow_state {
 	__be32 cur_daddr;
 	int count;
@@ -358,6 +382,14 @@ struct pktgen_dev {
 	/* Maps 0-IMIX_PRECISION range to imix_entry based on probability*/
 	__u8 imix_distribution[IMIX_PRECISION];
 
+	/* Flow templates, picked by weight for every packet (IPv4 only) */
+	unsigned int n_flow_tmpls;
+	struct flow_tmpl flow_tmpls[MAX_FLOW_TMPLS];
+
+	/* xdp_xmit mode */
+	struct pktgen_xdp_slot *xdp_slots;
+	unsigned int xdp_next;
+
 	/* MPLS */
 	unsigned int nr_labels;	/* Depth of stack, 0 = no MPLS */
 	__be32 labels[MAX_MPLS_LABELS];
@@ -487,6 +519,7 @@ static void pktgen_stop_all_threads(struct pktgen_net *pn);
 
 static void pktgen_stop(struct pktgen_thread *t);
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev);
+static int pktgen_stop_device(struct pktgen_dev *pkt_dev);
 static void fill_imix_distribution(struct pktgen_dev *pkt_dev);
 
 /* Module parameters, defaults. */
@@ -579,6 +612,18 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		seq_puts(seq, "\n");
 	}
 
+	if (pkt_dev->n_flow_tmpls > 0) {
+		seq_puts(seq, "     flow_tmpl: ");
+		for (i = 0; i < pkt_dev->n_flow_tmpls; i++) {
+			const struct flow_tmpl *t = &pkt_dev->flow_tmpls[i];
+
+			seq_printf(seq, "%pI4,%pI4,%u,%u,%u ", &t->saddr,
+				   &t->daddr, t->udp_src, t->udp_dst,
+				   t->weight);
+		}
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq,
 		   "     frags: %d  delay: %llu  clone_skb: %d  ifname: %s\n",
 		   pkt_dev->nfrags, (unsigned long long) pkt_dev->delay,
@@ -665,6 +710,8 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		seq_puts(seq, "     xmit_mode: netif_receive\n");
 	else if (pkt_dev->xmit_mode == M_QUEUE_XMIT)
 		seq_puts(seq, "     xmit_mode: xmit_queue\n");
+	else if (pkt_dev->xmit_mode == M_XDP_XMIT)
+		seq_puts(seq, "     xmit_mode: xdp_xmit\n");
 
 	seq_puts(seq, "     Flags: ");
 
@@ -708,6 +755,16 @@ static int pktgen_if_show(struct seq_file *seq, void *v)
 		seq_puts(seq, "\n");
 	}
 
+	if (pkt_dev->n_flow_tmpls > 0) {
+		int i;
+
+		seq_puts(seq, "     flow_tmpl_counts: ");
+		for (i = 0; i < pkt_dev->n_flow_tmpls; i++)
+			seq_printf(seq, "%llu ",
+				   pkt_dev->flow_tmpls[i].count_so_far);
+		seq_puts(seq, "\n");
+	}
+
 	seq_printf(seq,
 		   "     started: %lluus  stopped: %lluus idle: %lluus\n",
 		   (unsigned long long) ktime_to_us(pkt_dev->started_at),
@@ -887,6 +944,73 @@ static ssize_t get_imix_entries(const char __user *buffer,
 	return i;
 }
 
+/* Parses flow templates from user buffer.
+ * The user buffer should consist of templates separated by spaces where
+ * each template consists of source address, destination address, UDP
+ * source port, UDP destination port and weight delimited by commas.
+ * "10.0.0.1,10.1.0.1,9,9,3 10.0.0.2,10.1.0.2,9,53,1" for example.
+ * An empty buffer removes all templates.
+ */
+static ssize_t get_flow_tmpls(const char __user *buffer, size_t maxlen,
+			      struct pktgen_dev *pkt_dev)
+{
+	unsigned int n = 0;
+	u32 total = 0;
+	size_t i = 0;
+	char c = ' ';
+
+	pkt_dev->n_flow_tmpls = 0;
+
+	while (c == ' ' && i < maxlen) {
+		struct flow_tmpl *t = &pkt_dev->flow_tmpls[n];
+		char buf[64], *p = buf, *tok[5];
+		int len, k;
+
+		len = strn_len(&buffer[i], min(sizeof(buf) - 1, maxlen - i));
+		if (len < 0)
+			return len;
+		if (!len)
+			break;
+		if (n >= MAX_FLOW_TMPLS)
+			return -E2BIG;
+
+		if (copy_from_user(buf, &buffer[i], len))
+			return -EFAULT;
+		buf[len] = 0;
+		i += len;
+
+		for (k = 0; k < ARRAY_SIZE(tok); k++) {
+			tok[k] = strsep(&p, ",");
+			if (!tok[k])
+				return -EINVAL;
+		}
+		if (p)
+			return -EINVAL;
+
+		if (!in4_pton(tok[0], -1, (u8 *)&t->saddr, -1, NULL) ||
+		    !in4_pton(tok[1], -1, (u8 *)&t->daddr, -1, NULL) ||
+		    kstrtou16(tok[2], 10, &t->udp_src) ||
+		    kstrtou16(tok[3], 10, &t->udp_dst) ||
+		    kstrtou32(tok[4], 10, &t->weight) || !t->weight ||
+		    t->weight > U32_MAX - total)
+			return -EINVAL;
+
+		total += t->weight;
+		t->cum_weight = total;
+		t->count_so_far = 0;
+		n++;
+
+		if (i < maxlen) {
+			if (get_user(c, &buffer[i]))
+				return -EFAULT;
+			i++;
+		}
+	}
+
+	pkt_dev->n_flow_tmpls = n;
+	return i;
+}
+
 static ssize_t get_labels(const char __user *buffer, struct pktgen_dev *pkt_dev)
 {
 	unsigned int n = 0;
@@ -1069,6 +1193,16 @@ static ssize_t pktgen_if_write(struct file *file,
 		return count;
 	}
 
+	if (!strcmp(name, "flow_tmpl")) {
+		len = get_flow_tmpls(&user_buffer[i], count - i, pkt_dev);
+		if (len < 0)
+			return len;
+
+		i += len;
+		sprintf(pg_result, "OK: flow_tmpl=%u", pkt_dev->n_flow_tmpls);
+		return count;
+	}
+
 	if (!strcmp(name, "debug")) {
 		len = num_arg(&user_buffer[i], 10, &value);
 		if (len < 0)
@@ -1308,10 +1442,17 @@ static ssize_t pktgen_if_write(struct file *file,
 		} else if (strcmp(f, "queue_xmit") == 0) {
 			pkt_dev->xmit_mode = M_QUEUE_XMIT;
 			pkt_dev->last_ok = 1;
+		} else if (strcmp(f, "xdp_xmit") == 0) {
+			/* the driver has to take xdp_frames from other devices */
+			if (!pkt_dev->odev->netdev_ops->ndo_xdp_xmit)
+				return -ENOTSUPP;
+
+			pkt_dev->xmit_mode = M_XDP_XMIT;
+			pkt_dev->last_ok = 1;
 		} else {
 			sprintf(pg_result,
 				"xmit_mode -:%s:- unknown\nAvailable modes: %s",
-				f, "start_xmit, netif_receive\n");
+				f, "start_xmit, netif_receive, queue_xmit, xdp_xmit\n");
 			return count;
 		}
 		sprintf(pg_result, "OK: xmit_mode=%s", f);
@@ -2397,6 +2538,31 @@ static void set_cur_queue_map(struct pktgen_dev *pkt_dev)
 /* Increment/randomize headers according to flags and current values
  * for IP src/dest, UDP src/dst port, MAC-Addr src/dst
  */
+/* Templates override the address and port iterators. */
+static void pick_flow_tmpl(struct pktgen_dev *pkt_dev)
+{
+	unsigned int lo = 0, hi = pkt_dev->n_flow_tmpls - 1;
+	struct flow_tmpl *t;
+	u32 r;
+
+	r = prandom_u32_max(pkt_dev->flow_tmpls[hi].cum_weight);
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (pkt_dev->flow_tmpls[mid].cum_weight > r)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	t = &pkt_dev->flow_tmpls[lo];
+	t->count_so_far++;
+	pkt_dev->cur_saddr = t->saddr;
+	pkt_dev->cur_daddr = t->daddr;
+	pkt_dev->cur_udp_src = t->udp_src;
+	pkt_dev->cur_udp_dst = t->udp_dst;
+}
+
 static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 {
 	__u32 imn;
@@ -2576,6 +2742,9 @@ static void mod_cur_headers(struct pktgen_dev *pkt_dev)
 		}
 	}
 
+	if (pkt_dev->n_flow_tmpls > 0 && !(pkt_dev->flags & F_IPV6))
+		pick_flow_tmpl(pkt_dev);
+
 	if (pkt_dev->min_pkt_size < pkt_dev->max_pkt_size) {
 		__u32 t;
 		if (pkt_dev->flags & F_TXSIZE_RND) {
@@ -3125,6 +3294,163 @@ static struct sk_buff *fill_packet(struct net_device *odev,
 		return fill_packet_ipv4(odev, pkt_dev);
 }
 
+static void pktgen_xdp_free(struct pktgen_dev *pkt_dev)
+{
+	unsigned int i;
+
+	if (!pkt_dev->xdp_slots)
+		return;
+
+	/* frames still owned by the driver hold their own page reference */
+	for (i = 0; i < PKTGEN_XDP_POOL; i++)
+		if (pkt_dev->xdp_slots[i].page)
+			put_page(pkt_dev->xdp_slots[i].page);
+	kfree(pkt_dev->xdp_slots);
+	pkt_dev->xdp_slots = NULL;
+}
+
+/* Take the next slot of the pool and turn it into an xdp_frame. The packet
+ * is built with fill_packet() and copied into the slot's page, which is then
+ * sent again clone_skb times. A page the driver has not released yet is
+ * left to it and replaced.
+ */
+static struct xdp_frame *pktgen_xdp_frame(struct net_device *odev,
+					  struct pktgen_dev *pkt_dev)
+{
+	struct pktgen_xdp_slot *slot;
+	struct xdp_frame *xdpf;
+	struct sk_buff *skb;
+
+	slot = &pkt_dev->xdp_slots[pkt_dev->xdp_next];
+	if (++pkt_dev->xdp_next == PKTGEN_XDP_POOL)
+		pkt_dev->xdp_next = 0;
+
+	if (slot->page && page_ref_count(slot->page) != 1) {
+		put_page(slot->page);
+		slot->page = NULL;
+	}
+
+	if (!slot->page) {
+		int node = numa_node_id();
+
+		if (pkt_dev->node >= 0 && (pkt_dev->flags & F_NODE))
+			node = pkt_dev->node;
+		slot->page = alloc_pages_node(node, GFP_NOWAIT, 0);
+		if (!slot->page)
+			return ERR_PTR(-ENOMEM);
+		slot->len = 0;
+	}
+
+	xdpf = page_address(slot->page);
+
+	if (!slot->len || slot->uses >= max(pkt_dev->clone_skb, 1)) {
+		skb = fill_packet(odev, pkt_dev);
+		if (!skb)
+			return ERR_PTR(-ENOMEM);
+
+		if (skb->len > PKTGEN_XDP_MAX_LEN) {
+			kfree_skb(skb);
+			return ERR_PTR(-E2BIG);
+		}
+
+		slot->len = skb->len;
+		slot->uses = 0;
+		skb_copy_bits(skb, 0, (void *)xdpf + XDP_PACKET_HEADROOM,
+			      skb->len);
+		consume_skb(skb);
+		pkt_dev->seq_num++;
+	}
+	slot->uses++;
+
+	/* the previous user may have reused the headroom */
+	xdpf->data = (void *)xdpf + XDP_PACKET_HEADROOM;
+	xdpf->len = slot->len;
+	xdpf->headroom = XDP_PACKET_HEADROOM - sizeof(*xdpf);
+	xdpf->metasize = 0;
+	xdpf->frame_sz = PAGE_SIZE;
+	xdpf->mem.type = MEM_TYPE_PAGE_ORDER0;
+	xdpf->mem.id = 0;
+	xdpf->dev_rx = odev;
+	xdpf->flags = 0;
+
+	/* released by xdp_return_frame() */
+	get_page(slot->page);
+
+	return xdpf;
+}
+
+static void pktgen_xmit_xdp(struct pktgen_dev *pkt_dev)
+{
+	unsigned int burst = min_t(unsigned int, READ_ONCE(pkt_dev->burst),
+				   XDP_BULK_QUEUE_SIZE);
+	struct xdp_frame *frames[XDP_BULK_QUEUE_SIZE];
+	struct net_device *odev = pkt_dev->odev;
+	struct xdp_frame *xdpf;
+	unsigned int i, n;
+	u64 bytes = 0;
+	int nxmit;
+
+	if (unlikely(!pkt_dev->xdp_slots)) {
+		pkt_dev->xdp_slots = kcalloc(PKTGEN_XDP_POOL,
+					     sizeof(*pkt_dev->xdp_slots),
+					     GFP_KERNEL);
+		if (!pkt_dev->xdp_slots) {
+			sprintf(pkt_dev->result, "No memory");
+			pktgen_stop_device(pkt_dev);
+			return;
+		}
+	}
+
+	for (n = 0; n < burst; n++) {
+		xdpf = pktgen_xdp_frame(odev, pkt_dev);
+		if (IS_ERR(xdpf)) {
+			if (PTR_ERR(xdpf) == -E2BIG) {
+				sprintf(pkt_dev->result,
+					"Packet too large for xdp_xmit");
+				pktgen_stop_device(pkt_dev);
+			}
+			break;
+		}
+		frames[n] = xdpf;
+		bytes += xdpf->len;
+	}
+	if (!n) {
+		/* OOM, try again later */
+		schedule();
+		return;
+	}
+
+	if (pkt_dev->delay && pkt_dev->last_ok)
+		spin(pkt_dev, pkt_dev->next_tx);
+
+	local_bh_disable();
+	nxmit = odev->netdev_ops->ndo_xdp_xmit(odev, n, frames,
+					       XDP_XMIT_FLUSH);
+	local_bh_enable();
+
+	if (unlikely(nxmit < 0)) {
+		net_info_ratelimited("%s xdp xmit error: %d\n",
+				     pkt_dev->odevname, nxmit);
+		nxmit = 0;
+	}
+
+	/* frames not taken by the driver stay in their slot */
+	for (i = nxmit; i < n; i++) {
+		bytes -= frames[i]->len;
+		put_page(virt_to_page(frames[i]));
+	}
+
+	pkt_dev->last_ok = nxmit > 0;
+	pkt_dev->sofar += nxmit;
+	pkt_dev->tx_bytes += bytes;
+	pkt_dev->errors += n - nxmit;
+
+	/* If pkt_dev->count is zero, then run forever */
+	if (pkt_dev->running && pkt_dev->count != 0 &&
+	    pkt_dev->sofar >= pkt_dev->count)
+		pktgen_stop_device(pkt_dev);
+}
+
 static void pktgen_clear_counters(struct pktgen_dev *pkt_dev)
 {
 	pkt_dev->seq_num = 1;
@@ -3327,6 +3653,7 @@ static int pktgen_stop_device(struct pktgen_dev *pkt_dev)
 	pkt_dev->running = 0;
 	kfree_skb(pkt_dev->skb);
 	pkt_dev->skb = NULL;
+	pktgen_xdp_free(pkt_dev);
 	pkt_dev->stopped_at = ktime_get();
 
 	show_results(pkt_dev, nr_frags);
@@ -3463,6 +3790,11 @@ static void pktgen_xmit(struct pktgen_dev *pkt_dev)
 		return;
 	}
 
+	if (pkt_dev->xmit_mode == M_XDP_XMIT) {
+		pktgen_xmit_xdp(pkt_dev);
+		return;
+	}
+
 	/* If no skb or clone count exhausted then get new one */
 	if (!pkt_dev->skb || (pkt_dev->last_ok &&
 			      ++pkt_dev->clone_count >= pkt_dev->clone_skb)) {
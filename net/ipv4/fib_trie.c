@@ -163,11 +163,38 @@ struct trie_stat {
 	unsigned int nodesizes[MAX_STAT_DEPTH];
 };
 
+/* Direct-indexed first level: for every value of the top FIB_DIR_BITS of
+ * the key, the deepest node the trie walk is certain to reach, i.e. the
+ * first node whose index takes bits below that boundary, a leaf, or the
+ * node where the walk already fails.  Lookups resume the regular walk from
+ * there, skipping the upper levels of large tables.
+ *
+ * The array only stays valid while the shape of the trie does not change,
+ * so any structural update unpublishes it and schedules a rebuild once the
+ * table settles, or FIB_DIR_MAX_DELAY after the first update if it keeps
+ * changing.  Alias updates don't touch any node it points at.
+ */
+#define FIB_DIR_BITS	16
+#define FIB_DIR_SLOTS	(1ul << FIB_DIR_BITS)
+#define FIB_DIR_DELAY	(HZ / 10)
+#define FIB_DIR_MAX_DELAY	HZ
+
+struct fib_dir {
+	struct rcu_head rcu;
+	struct key_vector *slot[FIB_DIR_SLOTS];
+};
+
 struct trie {
 	struct key_vector kv[1];
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	struct trie_use_stats __percpu *stats;
 #endif
+	struct fib_dir __rcu *dir;
+	unsigned int leaves;
+	struct delayed_work dir_work;
+	unsigned long dir_deadline;
+	bool dir_pending;
+	possible_net_t net;
 };
 
 static struct key_vector *resize(struct trie *t, struct key_vector *tn);
@@ -198,6 +225,103 @@ static inline struct tnode *tn_info(struct key_vector *kv)
 #define node_parent_rcu(tn) rcu_dereference_rtnl(tn_info(tn)->parent)
 #define get_child_rcu(tn, i) rcu_dereference_rtnl((tn)->tnode[i])
 
+/* caller must hold RTNL */
+static void fib_dir_invalidate(struct trie *t)
+{
+	struct fib_dir *dir = rtnl_dereference(t->dir);
+	struct net *net = read_pnet(&t->net);
+	long delay;
+
+	if (dir) {
+		RCU_INIT_POINTER(t->dir, NULL);
+		kvfree_rcu(dir, rcu);
+	}
+
+	if (!READ_ONCE(net->ipv4.sysctl_fib_dir_min_leaves))
+		return;
+
+	/* push the rebuild back while the table churns, but no further
+	 * than FIB_DIR_MAX_DELAY past the first invalidation
+	 */
+	if (!t->dir_pending) {
+		t->dir_pending = true;
+		t->dir_deadline = jiffies + FIB_DIR_MAX_DELAY;
+	}
+
+	delay = min_t(long, FIB_DIR_DELAY, t->dir_deadline - jiffies);
+	mod_delayed_work(system_wq, &t->dir_work, max(delay, 0L));
+}
+
+/* caller must hold RTNL */
+static void fib_dir_build(struct trie *t)
+{
+	struct key_vector *root = get_child(t->kv, 0);
+	struct net *net = read_pnet(&t->net);
+	unsigned int min_leaves;
+	struct fib_dir *dir;
+	unsigned long s;
+
+	min_leaves = READ_ONCE(net->ipv4.sysctl_fib_dir_min_leaves);
+
+	if (rtnl_dereference(t->dir) || !root || !min_leaves ||
+	    t->leaves < min_leaves)
+		return;
+
+	dir = kvmalloc(sizeof(*dir), GFP_KERNEL);
+	if (!dir)
+		return;
+
+	for (s = 0; s < FIB_DIR_SLOTS; s++) {
+		t_key key = s << (KEYLENGTH - FIB_DIR_BITS);
+		struct key_vector *n = root;
+
+		while (IS_TNODE(n) && n->pos >= KEYLENGTH - FIB_DIR_BITS) {
+			unsigned long index = get_cindex(key, n);
+			struct key_vector *c;
+
+			if (index >= (1ul << n->bits))
+				break;
+
+			c = get_child(n, index);
+			if (!c)
+				break;
+
+			n = c;
+		}
+
+		dir->slot[s] = n;
+	}
+
+	rcu_assign_pointer(t->dir, dir);
+}
+
+static void fib_dir_work(struct work_struct *work)
+{
+	struct trie *t = container_of(to_delayed_work(work), struct trie,
+				      dir_work);
+
+	/* fib_free_table() cancels us with RTNL held */
+	if (!rtnl_trylock()) {
+		schedule_delayed_work(&t->dir_work, FIB_DIR_DELAY);
+		return;
+	}
+
+	t->dir_pending = false;
+	fib_dir_build(t);
+	rtnl_unlock();
+}
+
+static void fib_dir_free(struct trie *t)
+{
+	struct fib_dir *dir;
+
+	cancel_delayed_work_sync(&t->dir_work);
+
+	dir = rcu_dereference_protected(t->dir, 1);
+	if (dir)
+		kvfree_rcu(dir, rcu);
+}
+
 /* wrapper for rcu_assign_pointer */
 static inline void node_set_parent(struct key_vector *n, struct key_vector *tp)
 {
@@ -511,6 +635,8 @@ static struct key_vector *replace(struct trie *t,
 	struct key_vector *tp = node_parent(oldtnode);
 	unsigned long i;
 
+	fib_dir_invalidate(t);
+
 	/* setup the parent pointer out of and back into this node */
 	NODE_INIT_PARENT(tn, tp);
 	put_child_root(tp, tn->key, tn);
@@ -695,6 +821,7 @@ static struct key_vector *collapse(struct trie *t,
 		n = get_child(oldtnode, --i);
 
 	/* compress one level */
+	fib_dir_invalidate(t);
 	tp = node_parent(oldtnode);
 	put_child_root(tp, oldtnode->key, n);
 	node_set_parent(n, tp);
@@ -1115,6 +1242,9 @@ static int fib_insert_node(struct trie *t, struct key_vector *tp,
 	if (!l)
 		goto noleaf;
 
+	fib_dir_invalidate(t);
+	t->leaves++;
+
 	/* retrieve child from parent node */
 	n = get_child(tp, get_index(key, tp));
 
@@ -1151,6 +1281,7 @@ static int fib_insert_node(struct trie *t, struct key_vector *tp,
 
 	return 0;
 notnode:
+	t->leaves--;
 	node_free(l);
 noleaf:
 	return -ENOMEM;
@@ -1449,6 +1580,7 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 	const t_key key = ntohl(flp->daddr);
 	struct key_vector *n, *pn;
 	struct fib_alias *fa;
+	struct fib_dir *dir;
 	unsigned long index;
 	t_key cindex;
 
@@ -1465,6 +1597,17 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 	this_cpu_inc(stats->gets);
 #endif
 
+	/* Skip the levels the top bits of the key decide on their own.
+	 * Starting from the parent is always safe for backtracing, it
+	 * may just visit a node the full walk would not have recorded.
+	 */
+	dir = rcu_dereference_rtnl(t->dir);
+	if (dir) {
+		n = dir->slot[key >> (KEYLENGTH - FIB_DIR_BITS)];
+		pn = node_parent_rcu(n);
+		cindex = IS_TRIE(pn) ? 0 : get_index(key, pn);
+	}
+
 	/* Step 1: Travel to the longest prefix match in the trie */
 	for (;;) {
 		index = get_cindex(key, n);
@@ -1660,6 +1803,8 @@ static void fib_remove_alias(struct trie *t, struct key_vector *tp,
 	if (hlist_empty(&l->leaf)) {
 		if (tp->slen == l->slen)
 			node_pull_suffix(tp, tp->pos);
+		fib_dir_invalidate(t);
+		t->leaves--;
 		put_child_root(tp, l->key, NULL);
 		node_free(l);
 		trie_rebalance(t, tp);
@@ -1843,6 +1988,8 @@ static void fib_trie_free(struct fib_table *tb)
 	struct hlist_node *tmp;
 	struct fib_alias *fa;
 
+	fib_dir_free(t);
+
 	/* walk trie in reverse order and free everything */
 	for (;;) {
 		struct key_vector *n;
@@ -1905,7 +2052,7 @@ struct fib_table *fib_trie_unmerge(struct fib_table *oldtb)
 	if (oldtb->tb_data == oldtb->__data)
 		return oldtb;
 
-	local_tb = fib_trie_table(RT_TABLE_LOCAL, NULL);
+	local_tb = fib_trie_table(read_pnet(&ot->net), RT_TABLE_LOCAL, NULL);
 	if (!local_tb)
 		return NULL;
 
@@ -2014,6 +2161,8 @@ void fib_table_flush_external(struct fib_table *tb)
 		n->slen = slen;
 
 		if (hlist_empty(&n->leaf)) {
+			fib_dir_invalidate(t);
+			t->leaves--;
 			put_child_root(pn, n->key, NULL);
 			node_free(n);
 		}
@@ -2096,6 +2245,8 @@ int fib_table_flush(struct net *net, struct fib_table *tb, bool flush_all)
 		n->slen = slen;
 
 		if (hlist_empty(&n->leaf)) {
+			fib_dir_invalidate(t);
+			t->leaves--;
 			put_child_root(pn, n->key, NULL);
 			node_free(n);
 		}
@@ -2255,6 +2406,9 @@ static void __trie_free_rcu(struct rcu_head *head)
 
 void fib_free_table(struct fib_table *tb)
 {
+	if (tb->tb_data == tb->__data)
+		fib_dir_free((struct trie *)tb->tb_data);
+
 	call_rcu(&tb->rcu, __trie_free_rcu);
 }
 
@@ -2400,7 +2554,8 @@ void __init fib_trie_init(void)
 					   0, SLAB_PANIC | SLAB_ACCOUNT, NULL);
 }
 
-struct fib_table *fib_trie_table(u32 id, struct fib_table *alias)
+struct fib_table *fib_trie_table(struct net *net, u32 id,
+				 struct fib_table *alias)
 {
 	struct fib_table *tb;
 	struct trie *t;
@@ -2423,6 +2578,8 @@ struct fib_table *fib_trie_table(u32 id, struct fib_table *alias)
 	t = (struct trie *) tb->tb_data;
 	t->kv[0].pos = KEYLENGTH;
 	t->kv[0].slen = KEYLENGTH;
+	write_pnet(&t->net, net);
+	INIT_DELAYED_WORK(&t->dir_work, fib_dir_work);
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	t->stats = alloc_percpu(struct trie_use_stats);
 	if (!t->stats) {
@@ -1346,6 +1346,13 @@ static struct ctl_table ipv4_net_table[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= SYSCTL_TWO,
 	},
+	{
+		.procname	= "fib_dir_min_leaves",
+		.data		= &init_net.ipv4.sysctl_fib_dir_min_leaves,
+		.maxlen		= sizeof(unsigned int),
+		.mode		= 0644,
+		.proc_handler	= proc_douintvec,
+	},
 	{ }
 };
 
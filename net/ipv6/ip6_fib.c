@@ -39,6 +39,27 @@
 
 static struct kmem_cache *fib6_node_kmem __read_mostly;
 
+/* Direct-indexed first level of a table's radix tree: for every value of
+ * the top FIB6_DIR_BITS of the destination, the deepest node the descent
+ * is certain to reach, i.e. the first one testing a bit past that prefix
+ * or the one where the descent ends.  fib6_node_lookup_1() starts there
+ * and backtracks through the same parents as the full walk.
+ *
+ * Appending a leaf below the last node of a descent keeps it valid, any
+ * other change of the tree shape drops it; it is rebuilt from a per-netns
+ * work once the table has been quiet for FIB6_DIR_DELAY, or at the latest
+ * FIB6_DIR_MAX_DELAY after the first change.
+ */
+#define FIB6_DIR_BITS	16
+#define FIB6_DIR_SLOTS	(1ul << FIB6_DIR_BITS)
+#define FIB6_DIR_DELAY	(HZ / 10)
+#define FIB6_DIR_MAX_DELAY	HZ
+
+struct fib6_dir {
+	struct rcu_head		rcu;
+	struct fib6_node	*slot[FIB6_DIR_SLOTS];
+};
+
 struct fib6_cleaner {
 	struct fib6_walker w;
 	struct net *net;
@@ -210,9 +231,113 @@ static void node_free(struct net *net, struct fib6_node *fn)
 	net->ipv6.rt6_stats->fib_nodes--;
 }
 
+static void fib6_dir_invalidate(struct net *net, struct fib6_table *table)
+{
+	unsigned long deadline, old;
+	struct fib6_dir *dir;
+	long delay;
+
+	dir = rcu_dereference_protected(table->tb6_dir,
+					lockdep_is_held(&table->tb6_lock));
+	if (dir) {
+		RCU_INIT_POINTER(table->tb6_dir, NULL);
+		kvfree_rcu(dir, rcu);
+	}
+
+	if (!READ_ONCE(net->ipv6.sysctl.fib_dir_min_routes))
+		return;
+
+	/* tables are invalidated under their own locks, the first one since
+	 * the last rebuild sets the deadline (0 means none is pending)
+	 */
+	deadline = READ_ONCE(net->ipv6.fib6_dir_deadline);
+	if (!deadline) {
+		deadline = (jiffies + FIB6_DIR_MAX_DELAY) ?: 1;
+		old = cmpxchg(&net->ipv6.fib6_dir_deadline, 0, deadline);
+		if (old)
+			deadline = old;
+	}
+
+	delay = min_t(long, FIB6_DIR_DELAY, deadline - jiffies);
+	mod_delayed_work(system_wq, &net->ipv6.fib6_dir_work, max(delay, 0L));
+}
+
+/* Fill @dir for @table if it wants one; returns true if @dir was used. */
+static bool fib6_dir_build(struct net *net, struct fib6_table *table,
+			   struct fib6_dir *dir)
+{
+	u32 min_routes = READ_ONCE(net->ipv6.sysctl.fib_dir_min_routes);
+	unsigned long s;
+
+	if (rcu_access_pointer(table->tb6_dir) || !min_routes ||
+	    table->tb6_routes < min_routes)
+		return false;
+
+	for (s = 0; s < FIB6_DIR_SLOTS; s++) {
+		struct in6_addr addr = {};
+		struct fib6_node *fn = &table->tb6_root;
+
+		addr.s6_addr16[0] = htons(s);
+
+		while (fn->fn_bit < FIB6_DIR_BITS) {
+			struct fib6_node *next;
+
+			next = addr_bit_set(&addr, fn->fn_bit) ?
+			       rcu_dereference_protected(fn->right,
+					lockdep_is_held(&table->tb6_lock)) :
+			       rcu_dereference_protected(fn->left,
+					lockdep_is_held(&table->tb6_lock));
+			if (!next)
+				break;
+			fn = next;
+		}
+
+		dir->slot[s] = fn;
+	}
+
+	rcu_assign_pointer(table->tb6_dir, dir);
+	return true;
+}
+
+static void fib6_dir_work(struct work_struct *work)
+{
+	struct net *net = container_of(to_delayed_work(work), struct net,
+				       ipv6.fib6_dir_work);
+	struct fib6_table *table;
+	struct fib6_dir *dir;
+	bool used = false;
+	unsigned int h;
+
+	WRITE_ONCE(net->ipv6.fib6_dir_deadline, 0);
+
+	/* one table per run, the allocation can't happen under the lock */
+	dir = kvmalloc(sizeof(*dir), GFP_KERNEL);
+	if (!dir)
+		return;
+
+	rcu_read_lock();
+	for (h = 0; h < FIB6_TABLE_HASHSZ && !used; h++) {
+		hlist_for_each_entry_rcu(table, &net->ipv6.fib_table_hash[h],
+					 tb6_hlist) {
+			spin_lock_bh(&table->tb6_lock);
+			used = fib6_dir_build(net, table, dir);
+			spin_unlock_bh(&table->tb6_lock);
+			if (used)
+				break;
+		}
+	}
+	rcu_read_unlock();
+
+	if (used)
+		schedule_delayed_work(&net->ipv6.fib6_dir_work, 0);
+	else
+		kvfree(dir);
+}
+
 static void fib6_free_table(struct fib6_table *table)
 {
 	inetpeer_invalidate_tree(&table->tb6_peers);
+	kvfree(rcu_dereference_protected(table->tb6_dir, 1));
 	kfree(table);
 }
 
@@ -871,6 +996,8 @@ static struct fib6_node *fib6_add_1(struct net *net,
 
 	bit = __ipv6_addr_diff(addr, &key->addr, sizeof(*addr));
 
+	fib6_dir_invalidate(net, table);
+
 	/*
 	 *		(intermediate)[in]
 	 *	          /	   \
@@ -1251,6 +1378,7 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct fib6_info *rt,
 		if (!info->skip_notify)
 			inet6_rt_notify(RTM_NEWROUTE, rt, info, nlflags);
 		info->nl_net->ipv6.rt6_stats->fib_rt_entries++;
+		rt->fib6_table->tb6_routes++;
 
 		if (!(fn->fn_flags & RTN_RTINFO)) {
 			info->nl_net->ipv6.rt6_stats->fib_route_nodes++;
@@ -1309,6 +1437,7 @@ static int fib6_add_rt2node(struct fib6_node *fn, struct fib6_info *rt,
 					fib6_info_release(iter);
 					nsiblings--;
 					info->nl_net->ipv6.rt6_stats->fib_rt_entries--;
+					iter->fib6_table->tb6_routes--;
 				} else {
 					ins = &iter->fib6_next;
 				}
@@ -1636,7 +1765,18 @@ struct fib6_node *fib6_node_lookup(struct fib6_node *root,
 		}
 	};
 
-	fn = fib6_node_lookup_1(root, daddr ? args : args + 1);
+	fn = root;
+	if (daddr && root->fn_flags & RTN_TL_ROOT) {
+		struct fib6_table *table;
+		struct fib6_dir *dir;
+
+		table = container_of(root, struct fib6_table, tb6_root);
+		dir = rcu_dereference(table->tb6_dir);
+		if (dir)
+			fn = dir->slot[ntohs(daddr->s6_addr16[0])];
+	}
+
+	fn = fib6_node_lookup_1(fn, daddr ? args : args + 1);
 	if (!fn || fn->fn_flags & RTN_TL_ROOT)
 		fn = root;
 
@@ -1844,6 +1984,8 @@ static struct fib6_node *fib6_repair_tree(struct net *net,
 			return pn;
 		}
 
+		fib6_dir_invalidate(net, table);
+
 #ifdef CONFIG_IPV6_SUBTREES
 		if (FIB6_SUBTREE(pn) == fn) {
 			WARN_ON(!(fn->fn_flags & RTN_ROOT));
@@ -1931,6 +2073,7 @@ static void fib6_del_route(struct fib6_table *table, struct fib6_node *fn,
 	rt->fib6_node = NULL;
 	net->ipv6.rt6_stats->fib_rt_entries--;
 	net->ipv6.rt6_stats->fib_discarded_routes++;
+	table->tb6_routes--;
 
 	/* Reset round-robin state, if necessary */
 	if (rcu_access_pointer(fn->rr_ptr) == rt)
@@ -2365,6 +2508,7 @@ static int __net_init fib6_net_init(struct net *net)
 	rwlock_init(&net->ipv6.fib6_walker_lock);
 	INIT_LIST_HEAD(&net->ipv6.fib6_walkers);
 	timer_setup(&net->ipv6.ip6_fib_timer, fib6_gc_timer_cb, 0);
+	INIT_DELAYED_WORK(&net->ipv6.fib6_dir_work, fib6_dir_work);
 
 	net->ipv6.rt6_stats = kzalloc(sizeof(*net->ipv6.rt6_stats), GFP_KERNEL);
 	if (!net->ipv6.rt6_stats)
@@ -2423,6 +2567,7 @@ static void fib6_net_exit(struct net *net)
 	unsigned int i;
 
 	del_timer_sync(&net->ipv6.ip6_fib_timer);
+	cancel_delayed_work_sync(&net->ipv6.fib6_dir_work);
 
 	for (i = 0; i < FIB6_TABLE_HASHSZ; i++) {
 		struct hlist_head *head = &net->ipv6.fib_table_hash[i];
@@ -6425,6 +6425,13 @@ static struct ctl_table ipv6_route_table_template[] = {
 		.extra1		=	SYSCTL_ZERO,
 		.extra2		=	SYSCTL_ONE,
 	},
+	{
+		.procname	=	"fib_dir_min_routes",
+		.data		=	&init_net.ipv6.sysctl.fib_dir_min_routes,
+		.maxlen		=	sizeof(u32),
+		.mode		=	0644,
+		.proc_handler	=	proc_douintvec,
+	},
 	{ }
 };
 
@@ -6449,6 +6456,7 @@ struct ctl_table * __net_init ipv6_route_sysctl_init(struct net *net)
 		table[8].data = &net->ipv6.sysctl.ip6_rt_min_advmss;
 		table[9].data = &net->ipv6.sysctl.ip6_rt_gc_min_interval;
 		table[10].data = &net->ipv6.sysctl.skip_notify_on_dev_down;
+		table[11].data = &net->ipv6.sysctl.fib_dir_min_routes;
 
 		/* Don't export sysctls to unprivileged users */
 		if (net->user_ns != &init_user_ns)
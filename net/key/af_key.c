@@ -764,6 +764,7 @@ static struct sk_buff *__pfkey_xfrm_state2msg(const struct xfrm_state *x,
 	struct sadb_msg *hdr;
 	struct sadb_sa *sa;
 	struct sadb_lifetime *lifetime;
+	struct xfrm_lifetime_cur curlft;
 	struct sadb_address *addr;
 	struct sadb_key *key;
 	struct sadb_x_sa2 *sa2;
@@ -904,10 +905,11 @@ static struct sk_buff *__pfkey_xfrm_state2msg(const struct xfrm_state *x,
 	lifetime->sadb_lifetime_len =
 		sizeof(struct sadb_lifetime)/sizeof(uint64_t);
 	lifetime->sadb_lifetime_exttype = SADB_EXT_LIFETIME_CURRENT;
-	lifetime->sadb_lifetime_allocations = x->curlft.packets;
-	lifetime->sadb_lifetime_bytes = x->curlft.bytes;
-	lifetime->sadb_lifetime_addtime = x->curlft.add_time;
-	lifetime->sadb_lifetime_usetime = x->curlft.use_time;
+	xfrm_state_curlft(x, &curlft);
+	lifetime->sadb_lifetime_allocations = curlft.packets;
+	lifetime->sadb_lifetime_bytes = curlft.bytes;
+	lifetime->sadb_lifetime_addtime = curlft.add_time;
+	lifetime->sadb_lifetime_usetime = curlft.use_time;
 	/* src address */
 	addr = skb_put(skb, sizeof(struct sadb_address) + sockaddr_size);
 	addr->sadb_address_len =
@@ -30,6 +30,7 @@
 #include <net/cfg80211.h>
 #include <net/mac80211.h>
 #include <net/fq.h>
+#include <net/gro_cells.h>
 #include "key.h"
 #include "sta_info.h"
 #include "debug.h"
@@ -1012,6 +1013,9 @@ struct ieee80211_sub_if_data {
 	struct net_device *dev;
 	struct ieee80211_local *local;
 
+	/* GRO for frames received without a driver NAPI context */
+	struct gro_cells gro_cells;
+
 	unsigned int flags;
 
 	unsigned long state;
@@ -1659,6 +1659,7 @@ int ieee80211_do_open(struct wireless_dev *wdev, bool coming_up)
 
 static void ieee80211_if_free(struct net_device *dev)
 {
+	gro_cells_destroy(&IEEE80211_DEV_TO_SUB_IF(dev)->gro_cells);
 	free_percpu(dev->tstats);
 }
 
@@ -2308,6 +2309,14 @@ int ieee80211_if_add(struct ieee80211_local *local, const char *name,
 			return -ENOMEM;
 		}
 
+		ret = gro_cells_init(&IEEE80211_DEV_TO_SUB_IF(ndev)->gro_cells,
+				     ndev);
+		if (ret) {
+			ieee80211_if_free(ndev);
+			free_netdev(ndev);
+			return ret;
+		}
+
 		ndev->needed_headroom = local->tx_headroom +
 					4*6 /* four MAC addresses */
 					+ 2 + 2 + 2 + 2 /* ctl, dur, seq, qos */
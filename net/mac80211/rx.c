@@ -5134,6 +5134,28 @@ void ieee80211_rx_list(struct ieee80211_hw *hw, struct ieee80211_sta *pubsta,
 }
 EXPORT_SYMBOL(ieee80211_rx_list);
 
+/*
+ * Without a NAPI context from the driver there is no GRO instance to feed,
+ * so queue the frames on the interface's GRO cells instead. This lets the
+ * MSDUs of an A-MSDU be merged before they go up the stack. Frames for
+ * interfaces that have GRO turned off stay on the list.
+ */
+static void ieee80211_rx_list_to_gro_cells(struct list_head *list)
+{
+	struct sk_buff *skb, *tmp;
+
+	list_for_each_entry_safe(skb, tmp, list, list) {
+		struct ieee80211_sub_if_data *sdata;
+
+		if (netif_elide_gro(skb->dev))
+			continue;
+
+		sdata = IEEE80211_DEV_TO_SUB_IF(skb->dev);
+		skb_list_del_init(skb);
+		gro_cells_receive(&sdata->gro_cells, skb);
+	}
+}
+
 void ieee80211_rx_napi(struct ieee80211_hw *hw, struct ieee80211_sta *pubsta,
 		       struct sk_buff *skb, struct napi_struct *napi)
 {
@@ -5148,6 +5170,8 @@ void ieee80211_rx_napi(struct ieee80211_hw *hw, struct ieee80211_sta *pubsta,
 	 */
 	rcu_read_lock();
 	ieee80211_rx_list(hw, pubsta, skb, &list);
+	if (!napi)
+		ieee80211_rx_list_to_gro_cells(&list);
 	rcu_read_unlock();
 
 	if (!napi) {
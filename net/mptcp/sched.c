@@ -0,0 +1,276 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP
+ *
+ * Packet scheduler framework and built-in schedulers.
+ */
+
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <net/net_namespace.h>
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* Pick active subflows in turn, msk->last_snd is the cursor. */
+static struct sock *mptcp_sched_rr_get_subflow(struct mptcp_sock *msk)
+{
+	struct sock *first[SSK_MODE_MAX] = { NULL };
+	struct sock *next[SSK_MODE_MAX] = { NULL };
+	struct mptcp_subflow_context *subflow;
+	bool passed = !msk->last_snd;
+	int nr_active = 0;
+	struct sock *ssk;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		ssk = mptcp_subflow_tcp_sock(subflow);
+		if (!mptcp_subflow_active(subflow))
+			continue;
+
+		nr_active += !subflow->backup;
+		if (sk_stream_memory_free(ssk)) {
+			if (!first[subflow->backup])
+				first[subflow->backup] = ssk;
+			if (passed && !next[subflow->backup])
+				next[subflow->backup] = ssk;
+		}
+		if (ssk == msk->last_snd)
+			passed = true;
+	}
+
+	if (nr_active)
+		ssk = next[SSK_MODE_ACTIVE] ?: first[SSK_MODE_ACTIVE];
+	else
+		ssk = next[SSK_MODE_BACKUP] ?: first[SSK_MODE_BACKUP];
+	if (!ssk)
+		return NULL;
+
+	mptcp_set_timeout((struct sock *)msk);
+	msk->last_snd = ssk;
+	return ssk;
+}
+
+/* Pick the active subflow with the lowest smoothed RTT. */
+static struct sock *mptcp_sched_minrtt_get_subflow(struct mptcp_sock *msk)
+{
+	struct sock *best[SSK_MODE_MAX] = { NULL };
+	u32 best_rtt[SSK_MODE_MAX] = { U32_MAX, U32_MAX };
+	struct mptcp_subflow_context *subflow;
+	int nr_active = 0;
+	struct sock *ssk;
+
+	mptcp_for_each_subflow(msk, subflow) {
+		u32 srtt;
+
+		ssk = mptcp_subflow_tcp_sock(subflow);
+		if (!mptcp_subflow_active(subflow))
+			continue;
+
+		nr_active += !subflow->backup;
+		if (!sk_stream_memory_free(ssk))
+			continue;
+
+		/* subflows without a sample yet get probed first */
+		srtt = READ_ONCE(tcp_sk(ssk)->srtt_us);
+		if (srtt < best_rtt[subflow->backup]) {
+			best[subflow->backup] = ssk;
+			best_rtt[subflow->backup] = srtt;
+		}
+	}
+
+	ssk = best[nr_active ? SSK_MODE_ACTIVE : SSK_MODE_BACKUP];
+	if (!ssk)
+		return NULL;
+
+	mptcp_set_timeout((struct sock *)msk);
+	msk->last_snd = ssk;
+	return ssk;
+}
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_subflow_get_send,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+static struct mptcp_sched_ops mptcp_sched_rr = {
+	.get_subflow	= mptcp_sched_rr_get_subflow,
+	.name		= "roundrobin",
+	.owner		= THIS_MODULE,
+};
+
+static struct mptcp_sched_ops mptcp_sched_minrtt = {
+	.get_subflow	= mptcp_sched_minrtt_get_subflow,
+	.name		= "minrtt",
+	.owner		= THIS_MODULE,
+};
+
+/* must be called with rcu read lock or mptcp_sched_list_lock held */
+static struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list,
+				lockdep_is_held(&mptcp_sched_list_lock)) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (!sched->get_subflow)
+		return -EINVAL;
+
+	sched->stats = alloc_percpu(struct mptcp_sched_stats);
+	if (!sched->stats)
+		return -ENOMEM;
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		spin_unlock(&mptcp_sched_list_lock);
+		free_percpu(sched->stats);
+		sched->stats = NULL;
+		return -EEXIST;
+	}
+	list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	pr_debug("%s registered", sched->name);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (sched == &mptcp_sched_default)
+		return;
+
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	/* sockets pin the owner module, only list walkers can be left */
+	synchronize_rcu();
+	free_percpu(sched->stats);
+	sched->stats = NULL;
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+static void mptcp_sched_attach(struct mptcp_sock *msk,
+			       struct mptcp_sched_ops *sched)
+{
+	msk->sched = sched;
+	if (sched->init)
+		sched->init(msk);
+}
+
+/* Assign the scheduler selected by the netns sysctl, falling back to the
+ * default one if it is not (or no longer) registered.
+ */
+void mptcp_init_sched(struct mptcp_sock *msk)
+{
+	const char *name = mptcp_get_scheduler(sock_net((struct sock *)msk));
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = mptcp_sched_find(name);
+	if (!sched || !try_module_get(sched->owner))
+		sched = &mptcp_sched_default;
+	rcu_read_unlock();
+
+	mptcp_sched_attach(msk, sched);
+}
+
+/* msk was cloned from a listener holding a reference on msk->sched */
+void mptcp_clone_sched(struct mptcp_sock *msk)
+{
+	__module_get(msk->sched->owner);
+	mptcp_sched_attach(msk, msk->sched);
+}
+
+void mptcp_release_sched(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	msk->sched = NULL;
+	if (sched->release)
+		sched->release(msk);
+	module_put(sched->owner);
+}
+
+struct sock *mptcp_sched_get_send(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+	struct sock *ssk;
+
+	msk_owned_by_me(msk);
+
+	if (__mptcp_check_fallback(msk)) {
+		if (!msk->first)
+			return NULL;
+		return __tcp_can_send(msk->first) &&
+		       sk_stream_memory_free(msk->first) ? msk->first : NULL;
+	}
+
+	ssk = sched->get_subflow(msk);
+	if (ssk)
+		this_cpu_inc(sched->stats->picks);
+	else
+		this_cpu_inc(sched->stats->busy);
+	return ssk;
+}
+
+#ifdef CONFIG_PROC_FS
+static int mptcp_sched_seq_show(struct seq_file *seq, void *v)
+{
+	struct mptcp_sched_ops *sched;
+
+	seq_puts(seq, "name             picks                busy\n");
+
+	rcu_read_lock();
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		u64 picks = 0, busy = 0;
+		int cpu;
+
+		for_each_possible_cpu(cpu) {
+			const struct mptcp_sched_stats *stats;
+
+			stats = per_cpu_ptr(sched->stats, cpu);
+			picks += READ_ONCE(stats->picks);
+			busy += READ_ONCE(stats->busy);
+		}
+		seq_printf(seq, "%-16s %-20llu %llu\n", sched->name,
+			   picks, busy);
+	}
+	rcu_read_unlock();
+
+	return 0;
+}
+#endif
+
+void __init mptcp_sched_init(void)
+{
+	if (mptcp_register_scheduler(&mptcp_sched_default) ||
+	    mptcp_register_scheduler(&mptcp_sched_rr) ||
+	    mptcp_register_scheduler(&mptcp_sched_minrtt))
+		panic("Failed to register MPTCP schedulers\n");
+
+#ifdef CONFIG_PROC_FS
+	proc_create_single("mptcp_sched", 0444, init_net.proc_net,
+			   mptcp_sched_seq_show);
+#endif
+}
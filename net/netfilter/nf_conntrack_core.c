@@ -63,13 +63,38 @@ EXPORT_SYMBOL_GPL(nf_conntrack_expect_lock);
 struct hlist_nulls_head *nf_conntrack_hash __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 
+/* ~1s granules (a power of two, so slots stay consistent across jiffies
+ * wrap), ~4 minutes horizon.
+ */
+#define GC_WHEEL_SHIFT		ilog2(HZ)
+#define GC_WHEEL_GRAN		(1u << GC_WHEEL_SHIFT)
+#define GC_WHEEL_SLOTS		256u
+#define GC_WHEEL_BATCH		64u
+
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
+	struct delayed_work	wheel_dwork;
 	u32			next_bucket;
-	u32			avg_timeout;
 	u32			start_time;
 	bool			exiting;
 	bool			early_drop;
+	/* wheel worker sleeps GC_SCAN_INTERVAL_MAX, first insert re-arms it */
+	bool			wheel_idle;
+};
+
+/* Per-cpu expiry wheel. Conntracks are added on confirmation to the wheel
+ * of the confirming cpu, in the slot covering their timeout. The wheel
+ * worker only visits due slots, so reaping cost follows the number of
+ * expiring entries rather than the table size. Timeout updates don't
+ * touch the wheel: entries found not to be expired yet are moved to the
+ * slot of their new timeout when their old slot comes due.
+ */
+struct nf_ct_gc_wheel {
+	spinlock_t		lock;
+	/* start of the next granule to process */
+	u32			clock;
+	unsigned int		count;
+	struct hlist_head	slots[GC_WHEEL_SLOTS];
 };
 
 static __read_mostly struct kmem_cache *nf_conntrack_cachep;
@@ -79,17 +104,14 @@ static __read_mostly bool nf_conntrack_locks_all;
 /* serialize hash resizes and nf_ct_iterate_cleanup */
 static DEFINE_MUTEX(nf_conntrack_mutex);
 
+/* Expiry is tracked by the wheel, the full table scan is only needed
+ * for early drop, offloaded entries and conntracks inserted without
+ * going through __nf_conntrack_confirm().
+ */
 #define GC_SCAN_INTERVAL_MAX	(60ul * HZ)
+/* rescan interval while the table is full and early drop is needed */
 #define GC_SCAN_INTERVAL_MIN	(1ul * HZ)
 
-/* clamp timeouts to this value (TCP unacked) */
-#define GC_SCAN_INTERVAL_CLAMP	(300ul * HZ)
-
-/* large initial bias so that we don't scan often just because we have
- * three entries with a 1s timeout.
- */
-#define GC_SCAN_INTERVAL_INIT	INT_MAX
-
 #define GC_SCAN_MAX_DURATION	msecs_to_jiffies(10)
 #define GC_SCAN_EXPIRED_MAX	(64000u / HZ)
 
@@ -97,6 +119,7 @@ static DEFINE_MUTEX(nf_conntrack_mutex);
 #define MAX_CHAINLEN	(32u - MIN_CHAINLEN)
 
 static struct conntrack_gc_work conntrack_gc_work;
+static struct nf_ct_gc_wheel __percpu *nf_ct_gc_wheels __read_mostly;
 
 void nf_conntrack_lock(spinlock_t *lock) __acquires(lock)
 {
@@ -609,6 +632,68 @@ void nf_ct_destroy(struct nf_conntrack *nfct)
 }
 EXPORT_SYMBOL(nf_ct_destroy);
 
+static struct hlist_head *nf_ct_gc_wheel_slot(struct nf_ct_gc_wheel *w,
+					      u32 t)
+{
+	return &w->slots[(t >> GC_WHEEL_SHIFT) & (GC_WHEEL_SLOTS - 1)];
+}
+
+/* caller must hold w->lock */
+static void __nf_ct_gc_wheel_add(struct nf_ct_gc_wheel *w, struct nf_conn *ct)
+{
+	u32 timeout = READ_ONCE(ct->timeout);
+
+	if ((s32)(timeout - w->clock) < 0)
+		timeout = w->clock;
+
+	hlist_add_head(&ct->gc_node, nf_ct_gc_wheel_slot(w, timeout));
+	w->count++;
+}
+
+/* caller must hold w->lock */
+static void __nf_ct_gc_wheel_del(struct nf_ct_gc_wheel *w, struct nf_conn *ct)
+{
+	hlist_del_init(&ct->gc_node);
+	w->count--;
+}
+
+/* Called with the conntrack's hash bucket locks held, so that a concurrent
+ * nf_ct_delete() always finds ct->gc_wheel set.
+ */
+static void nf_ct_gc_wheel_insert(struct nf_conn *ct)
+{
+	struct nf_ct_gc_wheel *w = this_cpu_ptr(nf_ct_gc_wheels);
+	bool first;
+
+	spin_lock(&w->lock);
+	ct->gc_wheel = smp_processor_id() + 1;
+	__nf_ct_gc_wheel_add(w, ct);
+	first = w->count == 1;
+	spin_unlock(&w->lock);
+
+	/* pairs with the barrier in gc_wheel_worker(): either it sees this
+	 * entry or we see it going idle
+	 */
+	if (first && READ_ONCE(conntrack_gc_work.wheel_idle) &&
+	    xchg(&conntrack_gc_work.wheel_idle, false))
+		mod_delayed_work(system_power_efficient_wq,
+				 &conntrack_gc_work.wheel_dwork, GC_WHEEL_GRAN);
+}
+
+static void nf_ct_gc_wheel_remove(struct nf_conn *ct)
+{
+	struct nf_ct_gc_wheel *w;
+
+	if (!ct->gc_wheel)
+		return;
+
+	w = per_cpu_ptr(nf_ct_gc_wheels, ct->gc_wheel - 1);
+	spin_lock(&w->lock);
+	if (!hlist_unhashed(&ct->gc_node))
+		__nf_ct_gc_wheel_del(w, ct);
+	spin_unlock(&w->lock);
+}
+
 static void __nf_ct_delete_from_lists(struct nf_conn *ct)
 {
 	struct net *net = nf_ct_net(ct);
@@ -627,6 +712,8 @@ static void __nf_ct_delete_from_lists(struct nf_conn *ct)
 
 	clean_from_lists(ct);
 	nf_conntrack_double_unlock(hash, reply_hash);
+
+	nf_ct_gc_wheel_remove(ct);
 }
 
 static void nf_ct_delete_from_lists(struct nf_conn *ct)
@@ -929,6 +1016,7 @@ nf_conntrack_hash_check_insert(struct nf_conn *ct)
 	/* The caller holds a reference to this object */
 	refcount_set(&ct->ct_general.use, 2);
 	__nf_conntrack_hash_insert(ct, hash, reply_hash);
+	nf_ct_gc_wheel_insert(ct);
 	nf_conntrack_double_unlock(hash, reply_hash);
 	NF_CT_STAT_INC(net, insert);
 	local_bh_enable();
@@ -1263,6 +1351,7 @@ __nf_conntrack_confirm(struct sk_buff *skb)
 	 * stores are visible.
 	 */
 	__nf_conntrack_hash_insert(ct, hash, reply_hash);
+	nf_ct_gc_wheel_insert(ct);
 	nf_conntrack_double_unlock(hash, reply_hash);
 	local_bh_enable();
 
@@ -1473,12 +1562,8 @@ static void gc_worker(struct work_struct *work)
 	if (gc_work->early_drop)
 		nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
 
-	if (i == 0) {
-		gc_work->avg_timeout = GC_SCAN_INTERVAL_INIT;
+	if (i == 0)
 		gc_work->start_time = start_time;
-	}
-
-	next_run = gc_work->avg_timeout;
 
 	end_time = start_time + GC_SCAN_MAX_DURATION;
 
@@ -1498,7 +1583,6 @@ static void gc_worker(struct work_struct *work)
 
 		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
 			struct nf_conntrack_net *cnet;
-			unsigned long expires;
 			struct net *net;
 
 			tmp = nf_ct_tuplehash_to_ctrack(h);
@@ -1512,7 +1596,6 @@ static void gc_worker(struct work_struct *work)
 				rcu_read_unlock();
 
 				gc_work->next_bucket = i;
-				gc_work->avg_timeout = next_run;
 
 				delta_time = nfct_time_stamp - gc_work->start_time;
 
@@ -1527,10 +1610,6 @@ static void gc_worker(struct work_struct *work)
 				continue;
 			}
 
-			expires = clamp(nf_ct_expires(tmp), GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_CLAMP);
-			next_run += expires;
-			next_run /= 2u;
-
 			if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
 				continue;
 
@@ -1569,7 +1648,6 @@ static void gc_worker(struct work_struct *work)
 
 		delta_time = nfct_time_stamp - end_time;
 		if (delta_time > 0 && i < hashsz) {
-			gc_work->avg_timeout = next_run;
 			gc_work->next_bucket = i;
 			next_run = 0;
 			goto early_exit;
@@ -1578,7 +1656,8 @@ static void gc_worker(struct work_struct *work)
 
 	gc_work->next_bucket = 0;
 
-	next_run = clamp(next_run, GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_MAX);
+	next_run = gc_work->early_drop ? GC_SCAN_INTERVAL_MIN :
+					 GC_SCAN_INTERVAL_MAX;
 
 	delta_time = max_t(s32, nfct_time_stamp - gc_work->start_time, 1);
 	if (next_run > (unsigned long)delta_time)
@@ -1596,10 +1675,154 @@ static void gc_worker(struct work_struct *work)
 	queue_delayed_work(system_power_efficient_wq, &gc_work->dwork, next_run);
 }
 
+/* Reap the expired conntracks of one due wheel slot, in batches so that
+ * nf_ct_kill() runs without the wheel lock held.
+ */
+static void gc_wheel_run_slot(struct nf_ct_gc_wheel *w, struct hlist_head *slot)
+{
+	struct nf_conn *batch[GC_WHEEL_BATCH];
+	struct hlist_node *n;
+	unsigned int i, cnt;
+	struct nf_conn *ct;
+	HLIST_HEAD(due);
+
+	do {
+		cnt = 0;
+
+		spin_lock_bh(&w->lock);
+		hlist_move_list(slot, &due);
+		hlist_for_each_entry_safe(ct, n, &due, gc_node) {
+			if (cnt == GC_WHEEL_BATCH) {
+				/* left for the next round */
+				hlist_del(&ct->gc_node);
+				hlist_add_head(&ct->gc_node, slot);
+				continue;
+			}
+
+			__nf_ct_gc_wheel_del(w, ct);
+
+			/* timeout was extended: move it to its new slot */
+			if (!nf_ct_is_expired(ct)) {
+				__nf_ct_gc_wheel_add(w, ct);
+				continue;
+			}
+
+			/* in the wheel, so still referenced by the hash table */
+			if (refcount_inc_not_zero(&ct->ct_general.use))
+				batch[cnt++] = ct;
+		}
+		spin_unlock_bh(&w->lock);
+
+		rcu_read_lock();
+		for (i = 0; i < cnt; i++) {
+			ct = batch[i];
+
+			if (nf_ct_should_gc(ct)) {
+				nf_ct_kill(ct);
+			} else {
+				/* refreshed meanwhile: put it back unless
+				 * nf_ct_delete() already ran past the wheel.
+				 */
+				spin_lock_bh(&w->lock);
+				if (!nf_ct_is_dying(ct) &&
+				    hlist_unhashed(&ct->gc_node))
+					__nf_ct_gc_wheel_add(w, ct);
+				spin_unlock_bh(&w->lock);
+			}
+
+			nf_ct_put(ct);
+		}
+		rcu_read_unlock();
+
+		cond_resched();
+	} while (cnt == GC_WHEEL_BATCH);
+}
+
+static void gc_wheel_worker(struct work_struct *work)
+{
+	struct conntrack_gc_work *gc_work;
+	unsigned long next_run;
+	bool empty = true;
+	int cpu;
+
+	gc_work = container_of(work, struct conntrack_gc_work, wheel_dwork.work);
+
+	/* assume we go idle before looking at the wheels, so an insert into
+	 * an empty wheel after we looked at it re-arms us
+	 */
+	WRITE_ONCE(gc_work->wheel_idle, true);
+	smp_mb();
+
+	for_each_possible_cpu(cpu) {
+		struct nf_ct_gc_wheel *w = per_cpu_ptr(nf_ct_gc_wheels, cpu);
+		u32 now = nfct_time_stamp;
+		u32 lag;
+
+		spin_lock_bh(&w->lock);
+		/* after a long sleep every slot is due exactly once */
+		lag = (now - w->clock) >> GC_WHEEL_SHIFT;
+		if (lag > GC_WHEEL_SLOTS)
+			w->clock += (lag - GC_WHEEL_SLOTS) << GC_WHEEL_SHIFT;
+
+		while ((s32)(now - (w->clock + GC_WHEEL_GRAN)) >= 0) {
+			struct hlist_head *slot;
+
+			slot = nf_ct_gc_wheel_slot(w, w->clock);
+			w->clock += GC_WHEEL_GRAN;
+			spin_unlock_bh(&w->lock);
+
+			gc_wheel_run_slot(w, slot);
+
+			spin_lock_bh(&w->lock);
+		}
+
+		if (w->count)
+			empty = false;
+		spin_unlock_bh(&w->lock);
+	}
+
+	if (gc_work->exiting)
+		return;
+
+	if (!empty)
+		WRITE_ONCE(gc_work->wheel_idle, false);
+
+	/* nothing to track: don't wake up idle systems every second */
+	next_run = empty ? GC_SCAN_INTERVAL_MAX : GC_WHEEL_GRAN;
+	queue_delayed_work(system_power_efficient_wq, &gc_work->wheel_dwork,
+			   next_run);
+}
+
+static int nf_ct_gc_wheels_alloc(void)
+{
+	u32 now = nfct_time_stamp;
+	int cpu, i;
+
+	BUILD_BUG_ON(NR_CPUS >= U16_MAX);
+
+	nf_ct_gc_wheels = alloc_percpu(struct nf_ct_gc_wheel);
+	if (!nf_ct_gc_wheels)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct nf_ct_gc_wheel *w = per_cpu_ptr(nf_ct_gc_wheels, cpu);
+
+		spin_lock_init(&w->lock);
+		w->clock = now & ~(GC_WHEEL_GRAN - 1);
+		w->count = 0;
+		for (i = 0; i < GC_WHEEL_SLOTS; i++)
+			INIT_HLIST_HEAD(&w->slots[i]);
+	}
+
+	return 0;
+}
+
 static void conntrack_gc_work_init(struct conntrack_gc_work *gc_work)
 {
 	INIT_DELAYED_WORK(&gc_work->dwork, gc_worker);
+	INIT_DELAYED_WORK(&gc_work->wheel_dwork, gc_wheel_worker);
 	gc_work->exiting = false;
+	gc_work->wheel_idle = false;
 }
 
 static struct nf_conn *
@@ -1618,8 +1841,12 @@ __nf_conntrack_alloc(struct net *net,
 
 	if (nf_conntrack_max && unlikely(ct_count > nf_conntrack_max)) {
 		if (!early_drop(net, hash)) {
-			if (!conntrack_gc_work.early_drop)
+			if (!conntrack_gc_work.early_drop) {
 				conntrack_gc_work.early_drop = true;
+				/* don't wait for the next full scan */
+				mod_delayed_work(system_power_efficient_wq,
+						 &conntrack_gc_work.dwork, 0);
+			}
 			atomic_dec(&cnet->count);
 			net_warn_ratelimited("nf_conntrack: table full, dropping packet\n");
 			return ERR_PTR(-ENOMEM);
@@ -2519,6 +2746,8 @@ void nf_conntrack_cleanup_end(void)
 {
 	RCU_INIT_POINTER(nf_ct_hook, NULL);
 	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	cancel_delayed_work_sync(&conntrack_gc_work.wheel_dwork);
+	free_percpu(nf_ct_gc_wheels);
 	kvfree(nf_conntrack_hash);
 
 	nf_conntrack_proto_fini();
@@ -2737,8 +2966,14 @@ int nf_conntrack_init_start(void)
 	if (ret < 0)
 		goto err_proto;
 
+	ret = nf_ct_gc_wheels_alloc();
+	if (ret < 0)
+		goto err_wheel;
+
 	conntrack_gc_work_init(&conntrack_gc_work);
 	queue_delayed_work(system_power_efficient_wq, &conntrack_gc_work.dwork, HZ);
+	queue_delayed_work(system_power_efficient_wq,
+			   &conntrack_gc_work.wheel_dwork, GC_WHEEL_GRAN);
 
 	ret = register_nf_conntrack_bpf();
 	if (ret < 0)
@@ -2748,6 +2983,9 @@ int nf_conntrack_init_start(void)
 
 err_kfunc:
 	cancel_delayed_work_sync(&conntrack_gc_work.dwork);
+	cancel_delayed_work_sync(&conntrack_gc_work.wheel_dwork);
+	free_percpu(nf_ct_gc_wheels);
+err_wheel:
 	nf_conntrack_proto_fini();
 err_proto:
 	nf_conntrack_helper_fini();
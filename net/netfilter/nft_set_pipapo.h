@@ -68,7 +68,8 @@
 /* Definitions for vectorised implementations */
 #ifdef NFT_PIPAPO_ALIGN
 #define NFT_PIPAPO_ALIGN_HEADROOM					\
-	(NFT_PIPAPO_ALIGN - ARCH_KMALLOC_MINALIGN)
+	(NFT_PIPAPO_ALIGN > ARCH_KMALLOC_MINALIGN ?			\
+	 NFT_PIPAPO_ALIGN - ARCH_KMALLOC_MINALIGN : 0)
 #define NFT_PIPAPO_LT_ALIGN(lt)		(PTR_ALIGN((lt), NFT_PIPAPO_ALIGN))
 #define NFT_PIPAPO_LT_ASSIGN(field, x)					\
 	do {								\
@@ -176,6 +177,9 @@ struct nft_pipapo_elem {
 	struct nft_set_ext ext;
 };
 
+/* Vectorised implementations can be disabled for new sets, for comparison */
+extern bool nft_pipapo_simd;
+
 int pipapo_refill(unsigned long *map, int len, int rules, unsigned long *dst,
 		  union nft_pipapo_map_bucket *mt, bool match_only);
 
@@ -0,0 +1,239 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON packet lookup routines
+ *
+ * These are the arm64 Advanced SIMD counterparts of the AVX2 routines in
+ * nft_set_pipapo_avx2.c: buckets are intersected 128 bits at a time, and the
+ * same field sizes get dedicated, fully unrolled versions.
+ *
+ * This file is built with FP/SIMD registers enabled, and must only be called
+ * between kernel_neon_begin() and kernel_neon_end(), see
+ * nft_set_pipapo_neon.c.
+ */
+
+#include <linux/kernel.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+#include <net/netfilter/nf_tables_core.h>
+
+#include <asm/neon-intrinsics.h>
+
+#include "nft_set_pipapo_neon.h"
+#include "nft_set_pipapo.h"
+
+#define NFT_PIPAPO_LONGS_PER_M128	(NFT_PIPAPO_NEON_BITS / BITS_PER_LONG)
+
+/* Lookup table rows and scratch maps are aligned to NFT_PIPAPO_ALIGN bytes,
+ * bucket sizes are a multiple of it: whole 128-bit words can be loaded.
+ */
+#define NFT_PIPAPO_NEON_LOAD(loc)	vld1q_u64((const u64 *)(loc))
+#define NFT_PIPAPO_NEON_STORE(loc, v)	vst1q_u64((u64 *)(loc), (v))
+
+/**
+ * nft_pipapo_neon_refill() - Scan bitmap, select mapping table item, set bits
+ * @offset:	Start from given bitmap (equivalent to bucket) offset, in longs
+ * @map:	Bitmap to be scanned for set bits
+ * @dst:	Destination bitmap
+ * @mt:		Mapping table containing bit set specifiers
+ * @last:	Return index of first set bit, if this is the last field
+ *
+ * Same as nft_pipapo_avx2_refill(), for the two words of a 128-bit result.
+ *
+ * Return: first set bit index if @last, index of first filled word otherwise.
+ */
+static int nft_pipapo_neon_refill(int offset, unsigned long *map,
+				  unsigned long *dst,
+				  union nft_pipapo_map_bucket *mt, bool last)
+{
+	int ret = -1, x;
+
+	for (x = 0; x < NFT_PIPAPO_LONGS_PER_M128; x++) {
+		while (map[x]) {
+			int r = __ffs(map[x]);
+			int i = (offset + x) * BITS_PER_LONG + r;
+
+			if (last)
+				return i;
+
+			bitmap_set(dst, mt[i].to, mt[i].n);
+
+			if (ret == -1)
+				ret = mt[i].to;
+
+			map[x] &= ~(1UL << r);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * nft_pipapo_neon_field_lookup() - NEON-based lookup for one field
+ * @map:	Previous match result, used as initial bitmap
+ * @fill:	Destination bitmap to be filled with current match result
+ * @f:		Field, containing lookup and mapping tables
+ * @offset:	Ignore buckets before the given index, no bits are filled there
+ * @pkt:	Packet data, pointer to input nftables register
+ * @first:	If this is the first field, don't source previous result
+ * @last:	Last field: stop at the first match and return bit index
+ * @bb:		Bits per group, 4 or 8
+ * @groups:	Number of groups in the field
+ *
+ * Select the bucket row for each group of packet bits once, then walk the
+ * rows 128 bits at a time, intersecting them with the previous result. Rows
+ * are split between two accumulators to keep the AND chains independent,
+ * which matters on in-order cores such as Cortex-A53.
+ *
+ * Always inlined: with constant @bb and @groups the compiler unrolls the
+ * group loops, which gives the per-field-size versions below.
+ *
+ * Return: -1 on no match, rule index of match if @last, otherwise first
+ * 128-bit word index to be checked next (i.e. first filled word).
+ */
+static __always_inline int
+nft_pipapo_neon_field_lookup(unsigned long *map, unsigned long *fill,
+			     struct nft_pipapo_field *f, int offset,
+			     const u8 *pkt, bool first, bool last,
+			     int bb, int groups)
+{
+	const unsigned long *row[NFT_PIPAPO_MAX_BITS / 4];
+	const unsigned long *lt = NFT_PIPAPO_LT_ALIGN(f->lt);
+	unsigned long bsize = f->bsize;
+	int i, g, ret = -1, b;
+
+	for (g = 0; g < groups; g++) {
+		u8 v;
+
+		if (bb == 8)
+			v = pkt[g];
+		else
+			v = g % 2 ? pkt[g / 2] & 0xf : pkt[g / 2] >> 4;
+
+		row[g] = lt + (g * NFT_PIPAPO_BUCKETS(bb) + v) * bsize;
+	}
+
+	for (i = offset; i < bsize / NFT_PIPAPO_LONGS_PER_M128; i++) {
+		int i_ul = i * NFT_PIPAPO_LONGS_PER_M128;
+		uint64x2_t acc0, acc1;
+
+		/* Nothing matched here in previous fields, result stays zero */
+		if (!first && !(map[i_ul] | map[i_ul + 1]))
+			continue;
+
+		if (first)
+			acc0 = vdupq_n_u64(~0ULL);
+		else
+			acc0 = NFT_PIPAPO_NEON_LOAD(&map[i_ul]);
+		acc1 = NFT_PIPAPO_NEON_LOAD(row[0] + i_ul);
+
+		for (g = 1; g < groups; g += 2) {
+			acc0 = vandq_u64(acc0, NFT_PIPAPO_NEON_LOAD(row[g] + i_ul));
+			if (g + 1 < groups)
+				acc1 = vandq_u64(acc1,
+						 NFT_PIPAPO_NEON_LOAD(row[g + 1] + i_ul));
+		}
+		acc0 = vandq_u64(acc0, acc1);
+
+		if (!vmaxvq_u32(vreinterpretq_u32_u64(acc0))) {
+			NFT_PIPAPO_NEON_STORE(&map[i_ul], vdupq_n_u64(0));
+			continue;
+		}
+		NFT_PIPAPO_NEON_STORE(&map[i_ul], acc0);
+
+		b = nft_pipapo_neon_refill(i_ul, &map[i_ul], fill, f->mt, last);
+		if (last)
+			return b;
+
+		if (unlikely(ret == -1))
+			ret = b / NFT_PIPAPO_NEON_BITS;
+	}
+
+	return ret;
+}
+
+/* Unrolled versions for common field sizes, see nft_pipapo_avx2_lookup():
+ * 4-bit groups: 8-bit (2), 16-bit (4), 32-bit (8), 48-bit (12), 128-bit (32)
+ * 8-bit groups: 8-bit (1), 16-bit (2), 32-bit (4), 48-bit (6), 128-bit (16)
+ */
+#define NFT_PIPAPO_NEON_LOOKUP_FN(b, n)					\
+static int nft_pipapo_neon_lookup_##b##b_##n(unsigned long *map,	\
+					     unsigned long *fill,	\
+					     struct nft_pipapo_field *f, \
+					     int offset, const u8 *pkt,	\
+					     bool first, bool last)	\
+{									\
+	return nft_pipapo_neon_field_lookup(map, fill, f, offset, pkt,	\
+					    first, last, (b), (n));	\
+}
+
+NFT_PIPAPO_NEON_LOOKUP_FN(4, 2)
+NFT_PIPAPO_NEON_LOOKUP_FN(4, 4)
+NFT_PIPAPO_NEON_LOOKUP_FN(4, 8)
+NFT_PIPAPO_NEON_LOOKUP_FN(4, 12)
+NFT_PIPAPO_NEON_LOOKUP_FN(4, 32)
+NFT_PIPAPO_NEON_LOOKUP_FN(8, 1)
+NFT_PIPAPO_NEON_LOOKUP_FN(8, 2)
+NFT_PIPAPO_NEON_LOOKUP_FN(8, 4)
+NFT_PIPAPO_NEON_LOOKUP_FN(8, 6)
+NFT_PIPAPO_NEON_LOOKUP_FN(8, 16)
+
+#undef NFT_PIPAPO_NEON_LOOKUP_FN
+
+/**
+ * nft_pipapo_neon_lookup_field() - Match one field, pick unrolled version
+ * @map:	Previous match result, used as initial bitmap
+ * @fill:	Destination bitmap to be filled with current match result
+ * @f:		Field, containing lookup and mapping tables
+ * @offset:	Ignore buckets before the given index, no bits are filled there
+ * @pkt:	Packet data, pointer to input nftables register
+ * @first:	If this is the first field, don't source previous result
+ * @last:	Last field: stop at the first match and return bit index
+ *
+ * Uncommon field sizes use the generic, not unrolled, version.
+ *
+ * Return: -1 on no match, rule index of match if @last, otherwise first
+ * 128-bit word index to be checked next (i.e. first filled word).
+ */
+int nft_pipapo_neon_lookup_field(unsigned long *map, unsigned long *fill,
+				 struct nft_pipapo_field *f, int offset,
+				 const u8 *pkt, bool first, bool last)
+{
+#define NFT_SET_PIPAPO_NEON_LOOKUP(b, n)				\
+	nft_pipapo_neon_lookup_##b##b_##n(map, fill, f, offset, pkt,	\
+					  first, last)
+
+	NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+	if (likely(f->bb == 8)) {
+		switch (f->groups) {
+		case 1:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(8, 1);
+		case 2:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(8, 2);
+		case 4:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(8, 4);
+		case 6:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(8, 6);
+		case 16:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(8, 16);
+		}
+	} else {
+		switch (f->groups) {
+		case 2:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(4, 2);
+		case 4:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(4, 4);
+		case 8:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(4, 8);
+		case 12:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(4, 12);
+		case 32:
+			return NFT_SET_PIPAPO_NEON_LOOKUP(4, 32);
+		}
+	}
+
+#undef NFT_SET_PIPAPO_NEON_LOOKUP
+
+	return nft_pipapo_neon_field_lookup(map, fill, f, offset, pkt, first,
+					    last, f->bb, f->groups);
+}
@@ -1711,6 +1711,16 @@ static int netlink_setsockopt(struct socket *sock, int level, int optname,
 			nlk->flags &= ~NETLINK_F_STRICT_CHK;
 		err = 0;
 		break;
+	case NETLINK_DUMP_BATCH:
+		if (val && !ns_capable(sock_net(sk)->user_ns, CAP_NET_ADMIN))
+			return -EPERM;
+
+		if (val)
+			nlk->flags |= NETLINK_F_DUMP_BATCH;
+		else
+			nlk->flags &= ~NETLINK_F_DUMP_BATCH;
+		err = 0;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -1813,6 +1823,15 @@ static int netlink_getsockopt(struct socket *sock, int level, int optname,
 			return -EFAULT;
 		err = 0;
 		break;
+	case NETLINK_DUMP_BATCH:
+		if (len < sizeof(int))
+			return -EINVAL;
+		len = sizeof(int);
+		val = nlk->flags & NETLINK_F_DUMP_BATCH ? 1 : 0;
+		if (put_user(len, optlen) || put_user(val, optval))
+			return -EFAULT;
+		err = 0;
+		break;
 	default:
 		err = -ENOPROTOOPT;
 	}
@@ -2219,6 +2238,7 @@ static int netlink_dump(struct sock *sk)
 	int err = -ENOBUFS;
 	int alloc_min_size;
 	int alloc_size;
+	int batch = 0;
 
 	mutex_lock(nlk->cb_mutex);
 	if (!nlk->cb_running) {
@@ -2237,6 +2257,7 @@ static int netlink_dump(struct sock *sk)
 	cb = &nlk->cb;
 	alloc_min_size = max_t(int, cb->min_dump_alloc, NLMSG_GOODSIZE);
 
+next_skb:
 	if (alloc_min_size < nlk->max_recvmsg_len) {
 		alloc_size = nlk->max_recvmsg_len;
 		skb = alloc_skb(alloc_size,
@@ -2247,8 +2268,13 @@ static int netlink_dump(struct sock *sk)
 		alloc_size = alloc_min_size;
 		skb = alloc_skb(alloc_size, GFP_KERNEL);
 	}
-	if (!skb)
-		goto errout_skb;
+	if (!skb) {
+		/* what is already queued keeps the dump going */
+		if (!batch)
+			goto errout_skb;
+		mutex_unlock(nlk->cb_mutex);
+		return 0;
+	}
 
 	/* Trim skb to allocated size. User is expected to provide buffer as
 	 * large as max(min_dump_alloc, 16KiB (mac_recvmsg_len capped at
@@ -2278,12 +2304,24 @@ static int netlink_dump(struct sock *sk)
 
 	if (nlk->dump_done_errno > 0 ||
 	    skb_tailroom(skb) < nlmsg_total_size(sizeof(nlk->dump_done_errno))) {
-		mutex_unlock(nlk->cb_mutex);
-
 		if (sk_filter(sk, skb))
 			kfree_skb(skb);
 		else
 			__netlink_sendskb(sk, skb);
+		skb = NULL;
+
+		/* In batch mode keep filling skbs while the receiver has room
+		 * for them, instead of waiting for a recvmsg() per skb and
+		 * taking cb_mutex again for each one.
+		 */
+		if (nlk->flags & NETLINK_F_DUMP_BATCH &&
+		    ++batch < NETLINK_DUMP_BATCH_MAX &&
+		    atomic_read(&sk->sk_rmem_alloc) < sk->sk_rcvbuf &&
+		    !fatal_signal_pending(current)) {
+			cond_resched();
+			goto next_skb;
+		}
+		mutex_unlock(nlk->cb_mutex);
 		return 0;
 	}
 
@@ -16,6 +16,10 @@
 #define NETLINK_F_CAP_ACK		0x20
 #define NETLINK_F_EXT_ACK		0x40
 #define NETLINK_F_STRICT_CHK		0x80
+#define NETLINK_F_DUMP_BATCH		0x100
+
+/* upper bound on skbs queued by one netlink_dump() call in batch mode */
+#define NETLINK_DUMP_BATCH_MAX		32
 
 #define NLGRPSZ(x)	(ALIGN(x, sizeof(unsigned long) * 8) / 8)
 #define NLGRPLONGS(x)	(NLGRPSZ(x)/sizeof(unsigned long))
@@ -205,11 +205,9 @@ static void prb_open_block(struct tpacket_kbdq_core *,
 		struct tpacket_block_desc *);
 static void prb_retire_rx_blk_timer_expired(struct timer_list *);
 static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *);
-static void prb_fill_rxhash(struct tpacket_kbdq_core *, struct tpacket3_hdr *);
-static void prb_clear_rxhash(struct tpacket_kbdq_core *,
-		struct tpacket3_hdr *);
-static void prb_fill_vlan_info(struct tpacket_kbdq_core *,
-		struct tpacket3_hdr *);
+static void prb_fill_rxhash(struct sk_buff *, struct tpacket3_hdr *);
+static void prb_clear_rxhash(struct sk_buff *, struct tpacket3_hdr *);
+static void prb_fill_vlan_info(struct sk_buff *, struct tpacket3_hdr *);
 static void packet_flush_mclist(struct sock *sk);
 static u16 packet_pick_tx_queue(struct sk_buff *skb);
 
@@ -653,6 +651,37 @@ static void _prb_refresh_rx_retire_blk_timer(struct tpacket_kbdq_core *pkc)
 	pkc->last_kactive_blk_num = pkc->kactive_blk_num;
 }
 
+static bool prb_multi_producer(const struct tpacket_kbdq_core *pkc)
+{
+	return pkc->feature_req_word & TP_FT_REQ_MULTI_PRODUCER;
+}
+
+static void prb_mp_reset(struct tpacket_kbdq_core *pkc)
+{
+	u64 first = BLK_PLUS_PRIV(pkc->blk_sizeof_priv);
+
+	atomic64_set(&pkc->mp_rsv, (first << 32) | first);
+	atomic_set(&pkc->mp_num_pkts, 0);
+	atomic64_set(&pkc->mp_ts_first, S64_MAX);
+	atomic64_set(&pkc->mp_ts_last, S64_MIN);
+}
+
+/* Write the lockless reservation state back into the current block.
+ * Assumes blk_fill_in_prog_lock is held for writing, so that no frame
+ * of the block is still being filled, and that the block is owned by
+ * the kernel.
+ */
+static void prb_mp_sync_block(struct tpacket_kbdq_core *pkc,
+			      struct tpacket_block_desc *pbd)
+{
+	u64 rsv = atomic64_read(&pkc->mp_rsv);
+
+	BLOCK_LEN(pbd) = lower_32_bits(rsv);
+	BLOCK_NUM_PKTS(pbd) = atomic_read(&pkc->mp_num_pkts);
+	pkc->prev = pkc->pkblk_start + upper_32_bits(rsv);
+	pkc->nxt_offset = pkc->pkblk_start + lower_32_bits(rsv);
+}
+
 /*
  * Timer logic:
  * 1) We refresh the timer only when we open a block.
@@ -681,6 +710,7 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 	struct packet_sock *po =
 		from_timer(po, t, rx_ring.prb_bdqc.retire_blk_timer);
 	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	bool mp_locked = false;
 	unsigned int frozen;
 	struct tpacket_block_desc *pbd;
 
@@ -692,6 +722,17 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 	if (unlikely(pkc->delete_blk_timer))
 		goto out;
 
+	/* Multi-producer rings don't take sk_receive_queue.lock to reserve
+	 * frames, so keep them out for the whole retire/open sequence.
+	 */
+	if (prb_multi_producer(pkc)) {
+		write_lock(&pkc->blk_fill_in_prog_lock);
+		mp_locked = true;
+		if (!frozen)
+			prb_mp_sync_block(pkc, pbd);
+		goto check_blk;
+	}
+
 	/* We only need to plug the race when the block is partially filled.
 	 * tpacket_rcv:
 	 *		lock(); increment BLOCK_NUM_PKTS; unlock()
@@ -707,6 +748,7 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 		write_unlock(&pkc->blk_fill_in_prog_lock);
 	}
 
+check_blk:
 	if (pkc->last_kactive_blk_num == pkc->kactive_blk_num) {
 		if (!frozen) {
 			if (!BLOCK_NUM_PKTS(pbd)) {
@@ -746,6 +788,8 @@ static void prb_retire_rx_blk_timer_expired(struct timer_list *t)
 	_prb_refresh_rx_retire_blk_timer(pkc);
 
 out:
+	if (mp_locked)
+		write_unlock(&pkc->blk_fill_in_prog_lock);
 	spin_unlock(&po->sk.sk_receive_queue.lock);
 }
 
@@ -809,7 +853,24 @@ static void prb_close_block(struct tpacket_kbdq_core *pkc1,
 	last_pkt->tp_next_offset = 0;
 
 	/* Get the ts of the last pkt */
-	if (BLOCK_NUM_PKTS(pbd1)) {
+	if (BLOCK_NUM_PKTS(pbd1) && prb_multi_producer(pkc1)) {
+		/* Frames were not filled in arrival order, so report the
+		 * oldest and newest frame timestamps (hardware ones when
+		 * SOF_TIMESTAMPING_RAW_HARDWARE is enabled) instead.
+		 */
+		s64 first = atomic64_read(&pkc1->mp_ts_first);
+		s64 last = atomic64_read(&pkc1->mp_ts_last);
+		struct timespec64 ts;
+
+		if (first <= last) {
+			ts = ns_to_timespec64(first);
+			h1->ts_first_pkt.ts_sec = ts.tv_sec;
+			h1->ts_first_pkt.ts_nsec = ts.tv_nsec;
+			ts = ns_to_timespec64(last);
+			h1->ts_last_pkt.ts_sec = ts.tv_sec;
+			h1->ts_last_pkt.ts_nsec = ts.tv_nsec;
+		}
+	} else if (BLOCK_NUM_PKTS(pbd1)) {
 		h1->ts_last_pkt.ts_sec = last_pkt->tp_sec;
 		h1->ts_last_pkt.ts_nsec	= last_pkt->tp_nsec;
 	} else {
@@ -824,6 +885,12 @@ static void prb_close_block(struct tpacket_kbdq_core *pkc1,
 		h1->ts_last_pkt.ts_nsec	= ts.tv_nsec;
 	}
 
+	if (prb_multi_producer(pkc1)) {
+		/* Fail lockless reservations until the next block is open */
+		atomic64_set(&pkc1->mp_rsv, pkc1->kblk_size);
+		po->stats.stats1.tp_packets += BLOCK_NUM_PKTS(pbd1);
+	}
+
 	smp_wmb();
 
 	/* Flush the block */
@@ -877,6 +944,9 @@ static void prb_open_block(struct tpacket_kbdq_core *pkc1,
 	pkc1->prev = pkc1->nxt_offset;
 	pkc1->pkblk_end = pkc1->pkblk_start + pkc1->kblk_size;
 
+	if (prb_multi_producer(pkc1))
+		prb_mp_reset(pkc1);
+
 	prb_thaw_queue(pkc1);
 	_prb_refresh_rx_retire_blk_timer(pkc1);
 
@@ -990,24 +1060,21 @@ static void prb_clear_blk_fill_status(struct packet_ring_buffer *rb)
 	read_unlock(&pkc->blk_fill_in_prog_lock);
 }
 
-static void prb_fill_rxhash(struct tpacket_kbdq_core *pkc,
-			struct tpacket3_hdr *ppd)
+static void prb_fill_rxhash(struct sk_buff *skb, struct tpacket3_hdr *ppd)
 {
-	ppd->hv1.tp_rxhash = skb_get_hash(pkc->skb);
+	ppd->hv1.tp_rxhash = skb_get_hash(skb);
 }
 
-static void prb_clear_rxhash(struct tpacket_kbdq_core *pkc,
-			struct tpacket3_hdr *ppd)
+static void prb_clear_rxhash(struct sk_buff *skb, struct tpacket3_hdr *ppd)
 {
 	ppd->hv1.tp_rxhash = 0;
 }
 
-static void prb_fill_vlan_info(struct tpacket_kbdq_core *pkc,
-			struct tpacket3_hdr *ppd)
+static void prb_fill_vlan_info(struct sk_buff *skb, struct tpacket3_hdr *ppd)
 {
-	if (skb_vlan_tag_present(pkc->skb)) {
-		ppd->hv1.tp_vlan_tci = skb_vlan_tag_get(pkc->skb);
-		ppd->hv1.tp_vlan_tpid = ntohs(pkc->skb->vlan_proto);
+	if (skb_vlan_tag_present(skb)) {
+		ppd->hv1.tp_vlan_tci = skb_vlan_tag_get(skb);
+		ppd->hv1.tp_vlan_tpid = ntohs(skb->vlan_proto);
 		ppd->tp_status = TP_STATUS_VLAN_VALID | TP_STATUS_VLAN_TPID_VALID;
 	} else {
 		ppd->hv1.tp_vlan_tci = 0;
@@ -1017,20 +1084,22 @@ static void prb_fill_vlan_info(struct tpacket_kbdq_core *pkc,
 }
 
 static void prb_run_all_ft_ops(struct tpacket_kbdq_core *pkc,
-			struct tpacket3_hdr *ppd)
+			       struct sk_buff *skb,
+			       struct tpacket3_hdr *ppd)
 {
 	ppd->hv1.tp_padding = 0;
-	prb_fill_vlan_info(pkc, ppd);
+	prb_fill_vlan_info(skb, ppd);
 
 	if (pkc->feature_req_word & TP_FT_REQ_FILL_RXHASH)
-		prb_fill_rxhash(pkc, ppd);
+		prb_fill_rxhash(skb, ppd);
 	else
-		prb_clear_rxhash(pkc, ppd);
+		prb_clear_rxhash(skb, ppd);
 }
 
 static void prb_fill_curr_block(char *curr,
 				struct tpacket_kbdq_core *pkc,
 				struct tpacket_block_desc *pbd,
+				struct sk_buff *skb,
 				unsigned int len)
 	__acquires(&pkc->blk_fill_in_prog_lock)
 {
@@ -1043,7 +1112,7 @@ static void prb_fill_curr_block(char *curr,
 	BLOCK_LEN(pbd) += TOTAL_PKT_LEN_INCL_ALIGN(len);
 	BLOCK_NUM_PKTS(pbd) += 1;
 	read_lock(&pkc->blk_fill_in_prog_lock);
-	prb_run_all_ft_ops(pkc, ppd);
+	prb_run_all_ft_ops(pkc, skb, ppd);
 }
 
 /* Assumes caller has the sk->rx_queue.lock */
@@ -1081,12 +1150,11 @@ static void *__packet_lookup_frame_in_block(struct packet_sock *po,
 
 	smp_mb();
 	curr = pkc->nxt_offset;
-	pkc->skb = skb;
 	end = (char *)pbd + pkc->kblk_size;
 
 	/* first try the current block */
 	if (curr+TOTAL_PKT_LEN_INCL_ALIGN(len) < end) {
-		prb_fill_curr_block(curr, pkc, pbd, len);
+		prb_fill_curr_block(curr, pkc, pbd, skb, len);
 		return (void *)curr;
 	}
 
@@ -1097,7 +1165,7 @@ static void *__packet_lookup_frame_in_block(struct packet_sock *po,
 	curr = (char *)prb_dispatch_next_block(pkc, po);
 	if (curr) {
 		pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
-		prb_fill_curr_block(curr, pkc, pbd, len);
+		prb_fill_curr_block(curr, pkc, pbd, skb, len);
 		return (void *)curr;
 	}
 
@@ -1108,6 +1176,107 @@ static void *__packet_lookup_frame_in_block(struct packet_sock *po,
 	return NULL;
 }
 
+static bool prb_mp_reserve(struct tpacket_kbdq_core *pkc, unsigned int size,
+			   u32 *off)
+{
+	u64 old = atomic64_read(&pkc->mp_rsv);
+	u32 next;
+
+	do {
+		next = lower_32_bits(old);
+		if (next + size >= pkc->kblk_size)
+			return false;
+	} while (!atomic64_try_cmpxchg(&pkc->mp_rsv, &old,
+				       ((u64)next << 32) | (next + size)));
+
+	*off = next;
+	return true;
+}
+
+/* Retire the full current block and open the next one. Assumes
+ * sk_receive_queue.lock is held and blk_fill_in_prog_lock is held for
+ * writing. Returns false if user space hasn't released any block yet.
+ */
+static bool prb_mp_next_block(struct packet_sock *po,
+			      struct tpacket_kbdq_core *pkc,
+			      unsigned int size)
+{
+	struct tpacket_block_desc *pbd = GET_CURR_PBLOCK_DESC_FROM_CORE(pkc);
+
+	if (prb_queue_frozen(pkc)) {
+		if (prb_curr_blk_in_use(pbd))
+			return false;
+		prb_open_block(pkc, pbd);
+		return true;
+	}
+
+	/* Another producer may have moved on to a fresh block already */
+	if (lower_32_bits(atomic64_read(&pkc->mp_rsv)) + size < pkc->kblk_size)
+		return true;
+
+	if (likely(TP_STATUS_KERNEL == BLOCK_STATUS(pbd))) {
+		prb_mp_sync_block(pkc, pbd);
+		prb_close_block(pkc, pbd, po, 0);
+	}
+
+	return prb_dispatch_next_block(pkc, po);
+}
+
+/* TP_FT_REQ_MULTI_PRODUCER variant of __packet_lookup_frame_in_block().
+ * Frames in the current block are reserved with a cmpxchg, so RX CPUs
+ * only serialize on sk_receive_queue.lock when a block is retired.
+ * On success, returns with blk_fill_in_prog_lock held for reading.
+ */
+static void *prb_mp_lookup_frame(struct packet_sock *po, struct sk_buff *skb,
+				 unsigned int len)
+{
+	struct tpacket_kbdq_core *pkc = GET_PBDQC_FROM_RB(&po->rx_ring);
+	unsigned int size = TOTAL_PKT_LEN_INCL_ALIGN(len);
+	struct tpacket3_hdr *ppd;
+	bool more;
+	u32 off;
+
+	if (unlikely(BLK_PLUS_PRIV(pkc->blk_sizeof_priv) + size >=
+		     pkc->kblk_size))
+		return NULL;
+
+	for (;;) {
+		read_lock(&pkc->blk_fill_in_prog_lock);
+		if (prb_mp_reserve(pkc, size, &off))
+			break;
+		read_unlock(&pkc->blk_fill_in_prog_lock);
+
+		spin_lock(&po->sk.sk_receive_queue.lock);
+		write_lock(&pkc->blk_fill_in_prog_lock);
+		more = prb_mp_next_block(po, pkc, size);
+		write_unlock(&pkc->blk_fill_in_prog_lock);
+		spin_unlock(&po->sk.sk_receive_queue.lock);
+		if (!more)
+			return NULL;
+	}
+
+	ppd = (struct tpacket3_hdr *)(pkc->pkblk_start + off);
+	ppd->tp_next_offset = size;
+	atomic_inc(&pkc->mp_num_pkts);
+	prb_run_all_ft_ops(pkc, skb, ppd);
+
+	return ppd;
+}
+
+static void prb_mp_update_ts(struct tpacket_kbdq_core *pkc,
+			     const struct timespec64 *ts)
+{
+	s64 ns = timespec64_to_ns(ts);
+	s64 cur;
+
+	cur = atomic64_read(&pkc->mp_ts_first);
+	while (ns < cur && !atomic64_try_cmpxchg(&pkc->mp_ts_first, &cur, ns))
+		;
+	cur = atomic64_read(&pkc->mp_ts_last);
+	while (ns > cur && !atomic64_try_cmpxchg(&pkc->mp_ts_last, &cur, ns))
+		;
+}
+
 static void *packet_current_rx_frame(struct packet_sock *po,
 					    struct sk_buff *skb,
 					    int status, unsigned int len)
@@ -2252,6 +2421,7 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	bool is_drop_n_account = false;
 	unsigned int slot_id = 0;
 	bool do_vnet = false;
+	bool mp = false;
 
 	/* struct tpacket{2,3}_hdr is aligned to a multiple of TPACKET_ALIGNMENT.
 	 * We may add members to them until current aligned size without forcing
@@ -2354,9 +2524,15 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 			do_vnet = false;
 		}
 	}
-	spin_lock(&sk->sk_receive_queue.lock);
-	h.raw = packet_current_rx_frame(po, skb,
-					TP_STATUS_KERNEL, (macoff+snaplen));
+	if (po->tp_version == TPACKET_V3 &&
+	    prb_multi_producer(GET_PBDQC_FROM_RB(&po->rx_ring))) {
+		mp = true;
+		h.raw = prb_mp_lookup_frame(po, skb, macoff + snaplen);
+	} else {
+		spin_lock(&sk->sk_receive_queue.lock);
+		h.raw = packet_current_rx_frame(po, skb,
+						TP_STATUS_KERNEL, (macoff+snaplen));
+	}
 	if (!h.raw)
 		goto drop_n_account;
 
@@ -2388,13 +2564,16 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 			status |= TP_STATUS_LOSING;
 	}
 
-	po->stats.stats1.tp_packets++;
-	if (copy_skb) {
-		status |= TP_STATUS_COPY;
-		skb_clear_delivery_time(copy_skb);
-		__skb_queue_tail(&sk->sk_receive_queue, copy_skb);
+	/* Multi-producer rings account packets when the block is retired */
+	if (!mp) {
+		po->stats.stats1.tp_packets++;
+		if (copy_skb) {
+			status |= TP_STATUS_COPY;
+			skb_clear_delivery_time(copy_skb);
+			__skb_queue_tail(&sk->sk_receive_queue, copy_skb);
+		}
+		spin_unlock(&sk->sk_receive_queue.lock);
 	}
-	spin_unlock(&sk->sk_receive_queue.lock);
 
 	skb_copy_bits(skb, 0, h.raw + macoff, snaplen);
 
@@ -2449,6 +2628,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 		h.h3->tp_nsec = ts.tv_nsec;
 		memset(h.h3->tp_padding, 0, sizeof(h.h3->tp_padding));
 		hdrlen = sizeof(*h.h3);
+		if (mp)
+			prb_mp_update_ts(GET_PBDQC_FROM_RB(&po->rx_ring), &ts);
 		break;
 	default:
 		BUG();
@@ -2503,7 +2684,8 @@ static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
 	return 0;
 
 drop_n_account:
-	spin_unlock(&sk->sk_receive_queue.lock);
+	if (!mp)
+		spin_unlock(&sk->sk_receive_queue.lock);
 	atomic_inc(&po->tp_drops);
 	is_drop_n_account = true;
 
@@ -37,10 +37,20 @@ struct tpacket_kbdq_core {
 	uint64_t	knxt_seq_num;
 	char		*prev;
 	char		*nxt_offset;
-	struct sk_buff	*skb;
 
 	rwlock_t	blk_fill_in_prog_lock;
 
+	/* TP_FT_REQ_MULTI_PRODUCER: frames are reserved in the current block
+	 * without sk_receive_queue.lock. mp_rsv packs the block offset of
+	 * the last reserved frame (upper 32 bits) and of the next free byte
+	 * (lower 32 bits). BLOCK_LEN, BLOCK_NUM_PKTS and the block timestamps
+	 * are written back once, when the block is retired.
+	 */
+	atomic64_t	mp_rsv;
+	atomic_t	mp_num_pkts;
+	atomic64_t	mp_ts_first;
+	atomic64_t	mp_ts_last;
+
 	/* Default is set to 8ms */
 #define DEFAULT_PRB_RETIRE_TOV	(8)
 
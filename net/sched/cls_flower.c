@@ -11,6 +11,9 @@
 #include <linux/rhashtable.h>
 #include <linux/workqueue.h>
 #include <linux/refcount.h>
+#include <linux/jhash.h>
+#include <linux/percpu.h>
+#include <linux/u64_stats_sync.h>
 
 #include <linux/if_ether.h>
 #include <linux/in6.h>
@@ -97,13 +100,54 @@ struct fl_flow_tmplt {
 	struct tcf_chain *chain;
 };
 
+/* Exact match cache in front of the mask walk. Packets are dissected once
+ * for the union of all masks and the result of the walk is remembered per
+ * CPU for the masked key. The cache is a snapshot of the mask list: it is
+ * dropped whenever a mask is added or removed and rebuilt by a work
+ * FL_CACHE_DELAY later, so a burst of mask changes costs one rebuild.
+ * Filter changes only bump head->cache_gen which invalidates all entries.
+ */
+#define FL_CACHE_MIN_MASKS	4
+#define FL_CACHE_SIZE		64
+#define FL_CACHE_KEY_MAX	256
+#define FL_CACHE_DELAY		(HZ / 10)
+
+struct fl_cache_entry {
+	unsigned long gen;
+	struct cls_fl_filter *filter;	/* NULL if nothing matched */
+	u32 hash;
+	long key[FL_CACHE_KEY_MAX / sizeof(long)];
+};
+
+struct fl_cache {
+	struct fl_flow_key mask;	/* union of all masks */
+	struct fl_flow_mask_range range;
+	struct flow_dissector dissector;
+	struct fl_cache_entry *entries;	/* FL_CACHE_SIZE per CPU */
+	struct rcu_work rwork;
+	unsigned int nr_masks;
+	struct fl_flow_mask *masks[];
+};
+
+struct fl_cache_stats {
+	u64_stats_t hits;
+	u64_stats_t misses;
+	struct u64_stats_sync syncp;
+};
+
 struct cls_fl_head {
 	struct rhashtable ht;
-	spinlock_t masks_lock; /* Protect masks list */
+	spinlock_t masks_lock; /* Protect masks list and cache */
 	struct list_head masks;
+	unsigned int nr_masks;
 	struct list_head hw_filters;
 	struct rcu_work rwork;
 	struct idr handle_idr;
+	struct fl_cache __rcu *cache;
+	struct delayed_work cache_work;
+	atomic_long_t cache_gen;
+	struct fl_cache_stats __percpu *cache_stats;
+	bool cache_off;
 };
 
 struct cls_fl_filter {
@@ -140,10 +184,11 @@ static unsigned short int fl_mask_range(const struct fl_flow_mask *mask)
 	return mask->range.end - mask->range.start;
 }
 
-static void fl_mask_update_range(struct fl_flow_mask *mask)
+static void fl_key_get_range(const struct fl_flow_key *key,
+			     struct fl_flow_mask_range *range)
 {
-	const u8 *bytes = (const u8 *) &mask->key;
-	size_t size = sizeof(mask->key);
+	const u8 *bytes = (const u8 *) key;
+	size_t size = sizeof(*key);
 	size_t i, first = 0, last;
 
 	for (i = 0; i < size; i++) {
@@ -159,8 +204,13 @@ static void fl_mask_update_range(struct fl_flow_mask *mask)
 			break;
 		}
 	}
-	mask->range.start = rounddown(first, sizeof(long));
-	mask->range.end = roundup(last + 1, sizeof(long));
+	range->start = rounddown(first, sizeof(long));
+	range->end = roundup(last + 1, sizeof(long));
+}
+
+static void fl_mask_update_range(struct fl_flow_mask *mask)
+{
+	fl_key_get_range(&mask->key, &mask->range);
 }
 
 static void *fl_key_get_start(struct fl_flow_key *key,
@@ -304,33 +354,118 @@ static u16 fl_ct_info_to_flower_map[] = {
 					TCA_FLOWER_KEY_CT_FLAGS_NEW,
 };
 
+static void fl_dissect(struct sk_buff *skb, struct flow_dissector *dissector,
+		       struct fl_flow_key *skb_key)
+{
+	bool post_ct = tc_skb_cb(skb)->post_ct;
+	u16 zone = tc_skb_cb(skb)->zone;
+
+	skb_flow_dissect_meta(skb, dissector, skb_key);
+	/* skb_flow_dissect() does not set n_proto in case an unknown
+	 * protocol, so do it rather here.
+	 */
+	skb_key->basic.n_proto = skb_protocol(skb, false);
+	skb_flow_dissect_tunnel_info(skb, dissector, skb_key);
+	skb_flow_dissect_ct(skb, dissector, skb_key,
+			    fl_ct_info_to_flower_map,
+			    ARRAY_SIZE(fl_ct_info_to_flower_map),
+			    post_ct, zone);
+	skb_flow_dissect_hash(skb, dissector, skb_key);
+	skb_flow_dissect(skb, dissector, skb_key,
+			 FLOW_DISSECTOR_F_STOP_BEFORE_ENCAP);
+}
+
+/* Every mask is a subset of cache->mask, so masking the key with the union
+ * first does not change the result of any per-mask lookup.
+ */
+static struct cls_fl_filter *fl_cache_lookup(struct cls_fl_head *head,
+					     struct fl_cache *cache,
+					     unsigned long gen,
+					     struct sk_buff *skb,
+					     struct fl_flow_key *skb_key)
+{
+	unsigned int len = cache->range.end - cache->range.start;
+	struct fl_cache_stats *stats;
+	struct fl_cache_entry *entry;
+	struct cls_fl_filter *f;
+	const long *lmask;
+	unsigned int i;
+	long *lkey;
+	u32 hash;
+
+	lkey = (long *)((u8 *)skb_key + cache->range.start);
+	lmask = (const long *)((const u8 *)&cache->mask + cache->range.start);
+
+	flow_dissector_init_keys(&skb_key->control, &skb_key->basic);
+	memset(lkey, 0, len);
+	fl_dissect(skb, &cache->dissector, skb_key);
+
+	for (i = 0; i < len / sizeof(long); i++)
+		lkey[i] &= lmask[i];
+	hash = jhash2((u32 *)lkey, len / sizeof(u32), 0);
+
+	entry = &cache->entries[smp_processor_id() * FL_CACHE_SIZE +
+				(hash & (FL_CACHE_SIZE - 1))];
+	stats = this_cpu_ptr(head->cache_stats);
+
+	if (entry->gen == gen && entry->hash == hash &&
+	    !memcmp(entry->key, lkey, len)) {
+		u64_stats_update_begin(&stats->syncp);
+		u64_stats_inc(&stats->hits);
+		u64_stats_update_end(&stats->syncp);
+		return entry->filter;
+	}
+
+	f = NULL;
+	for (i = 0; i < cache->nr_masks; i++) {
+		f = fl_mask_lookup(cache->masks[i], skb_key);
+		if (f && !tc_skip_sw(f->flags))
+			break;
+		f = NULL;
+	}
+
+	entry->gen = gen;
+	entry->hash = hash;
+	entry->filter = f;
+	memcpy(entry->key, lkey, len);
+
+	u64_stats_update_begin(&stats->syncp);
+	u64_stats_inc(&stats->misses);
+	u64_stats_update_end(&stats->syncp);
+
+	return f;
+}
+
 static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 		       struct tcf_result *res)
 {
 	struct cls_fl_head *head = rcu_dereference_bh(tp->root);
-	bool post_ct = tc_skb_cb(skb)->post_ct;
-	u16 zone = tc_skb_cb(skb)->zone;
 	struct fl_flow_key skb_key;
 	struct fl_flow_mask *mask;
+	struct fl_cache *cache;
 	struct cls_fl_filter *f;
+	unsigned long gen;
+
+	/* Pairs with the barrier implied by atomic_long_inc_return() in
+	 * fl_cache_invalidate(). A new generation implies the cache
+	 * snapshot it was bumped for.
+	 */
+	gen = atomic_long_read(&head->cache_gen);
+	smp_rmb();
+	cache = rcu_dereference_bh(head->cache);
+	if (cache) {
+		f = fl_cache_lookup(head, cache, gen, skb, &skb_key);
+		if (!f)
+			return -1;
+		*res = f->res;
+		return tcf_exts_exec(skb, &f->exts, res);
+	}
 
 	list_for_each_entry_rcu(mask, &head->masks, list) {
 		flow_dissector_init_keys(&skb_key.control, &skb_key.basic);
 		fl_clear_masked_range(&skb_key, mask);
 
-		skb_flow_dissect_meta(skb, &mask->dissector, &skb_key);
-		/* skb_flow_dissect() does not set n_proto in case an unknown
-		 * protocol, so do it rather here.
-		 */
-		skb_key.basic.n_proto = skb_protocol(skb, false);
-		skb_flow_dissect_tunnel_info(skb, &mask->dissector, &skb_key);
-		skb_flow_dissect_ct(skb, &mask->dissector, &skb_key,
-				    fl_ct_info_to_flower_map,
-				    ARRAY_SIZE(fl_ct_info_to_flower_map),
-				    post_ct, zone);
-		skb_flow_dissect_hash(skb, &mask->dissector, &skb_key);
-		skb_flow_dissect(skb, &mask->dissector, &skb_key,
-				 FLOW_DISSECTOR_F_STOP_BEFORE_ENCAP);
+		fl_dissect(skb, &mask->dissector, &skb_key);
 
 		f = fl_mask_lookup(mask, &skb_key);
 		if (f && !tc_skip_sw(f->flags)) {
@@ -341,14 +476,28 @@ static int fl_classify(struct sk_buff *skb, const struct tcf_proto *tp,
 	return -1;
 }
 
+static void fl_cache_build_work(struct work_struct *work);
+
 static int fl_init(struct tcf_proto *tp)
 {
 	struct cls_fl_head *head;
+	int cpu;
 
 	head = kzalloc(sizeof(*head), GFP_KERNEL);
 	if (!head)
 		return -ENOBUFS;
 
+	head->cache_stats = alloc_percpu(struct fl_cache_stats);
+	if (!head->cache_stats) {
+		kfree(head);
+		return -ENOBUFS;
+	}
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&per_cpu_ptr(head->cache_stats, cpu)->syncp);
+	/* entries of a new cache are zeroed, never match generation 0 */
+	atomic_long_set(&head->cache_gen, 1);
+	INIT_DELAYED_WORK(&head->cache_work, fl_cache_build_work);
+
 	spin_lock_init(&head->masks_lock);
 	INIT_LIST_HEAD_RCU(&head->masks);
 	INIT_LIST_HEAD(&head->hw_filters);
@@ -358,6 +507,124 @@ static int fl_init(struct tcf_proto *tp)
 	return rhashtable_init(&head->ht, &mask_ht_params);
 }
 
+static void fl_cache_free(struct fl_cache *cache)
+{
+	kvfree(cache->entries);
+	kfree(cache);
+}
+
+static void fl_cache_free_work(struct work_struct *work)
+{
+	struct fl_cache *cache = container_of(to_rcu_work(work),
+					      struct fl_cache, rwork);
+
+	fl_cache_free(cache);
+}
+
+static void fl_cache_invalidate(struct cls_fl_head *head)
+{
+	atomic_long_inc_return(&head->cache_gen);
+}
+
+static void fl_init_dissector(struct flow_dissector *dissector,
+			      struct fl_flow_key *mask);
+
+/* The union key is dissected once for all masks, which only works if that
+ * dissection fills every key the masks look at. __skb_flow_dissect_ports()
+ * fills just one of PORTS and PORTS_RANGE, so a union using both is out.
+ */
+static bool fl_cache_usable(const struct fl_cache *cache)
+{
+	if (dissector_uses_key(&cache->dissector, FLOW_DISSECTOR_KEY_PORTS) &&
+	    dissector_uses_key(&cache->dissector,
+			       FLOW_DISSECTOR_KEY_PORTS_RANGE))
+		return false;
+
+	return cache->range.end - cache->range.start <= FL_CACHE_KEY_MAX;
+}
+
+/* Build a cache matching the current mask list, unless one is in place. */
+static void fl_cache_build_work(struct work_struct *work)
+{
+	struct cls_fl_head *head = container_of(to_delayed_work(work),
+						struct cls_fl_head, cache_work);
+	struct fl_flow_mask *mask;
+	unsigned int nr_masks, i;
+	struct fl_cache *cache;
+	const long *lmask;
+	long *lumask;
+
+again:
+	nr_masks = READ_ONCE(head->nr_masks);
+	if (nr_masks < FL_CACHE_MIN_MASKS || READ_ONCE(head->cache_off) ||
+	    rcu_access_pointer(head->cache))
+		return;
+
+	cache = kzalloc(struct_size(cache, masks, nr_masks), GFP_KERNEL);
+	if (!cache)
+		return;
+	cache->entries = kvcalloc(nr_cpu_ids * FL_CACHE_SIZE,
+				  sizeof(*cache->entries), GFP_KERNEL);
+	if (!cache->entries) {
+		kfree(cache);
+		return;
+	}
+
+	spin_lock(&head->masks_lock);
+	if (nr_masks != head->nr_masks) {
+		spin_unlock(&head->masks_lock);
+		fl_cache_free(cache);
+		goto again;
+	}
+
+	if (!head->cache_off && !rcu_access_pointer(head->cache)) {
+		lumask = (long *)&cache->mask;
+		i = 0;
+		list_for_each_entry(mask, &head->masks, list) {
+			unsigned int j;
+
+			lmask = (const long *)&mask->key;
+			for (j = mask->range.start / sizeof(long);
+			     j < mask->range.end / sizeof(long); j++)
+				lumask[j] |= lmask[j];
+			cache->masks[i++] = mask;
+		}
+		cache->nr_masks = i;
+		fl_key_get_range(&cache->mask, &cache->range);
+		fl_init_dissector(&cache->dissector, &cache->mask);
+
+		if (fl_cache_usable(cache)) {
+			rcu_assign_pointer(head->cache, cache);
+			cache = NULL;
+		}
+	}
+	spin_unlock(&head->masks_lock);
+
+	if (cache)
+		fl_cache_free(cache);
+}
+
+/* Drop the cache, it no longer matches the mask list. Must be called after
+ * every change of the list and before a removed mask is freed.
+ */
+static void fl_cache_drop(struct cls_fl_head *head)
+{
+	struct fl_cache *old;
+
+	spin_lock(&head->masks_lock);
+	old = rcu_replace_pointer(head->cache, NULL,
+				  lockdep_is_held(&head->masks_lock));
+	spin_unlock(&head->masks_lock);
+
+	fl_cache_invalidate(head);
+	if (old)
+		tcf_queue_work(&old->rwork, fl_cache_free_work);
+
+	if (!READ_ONCE(head->cache_off))
+		queue_delayed_work(system_wq, &head->cache_work,
+				   FL_CACHE_DELAY);
+}
+
 static void fl_mask_free(struct fl_flow_mask *mask, bool mask_init_done)
 {
 	/* temporary masks don't have their filters list and ht initialized */
@@ -393,8 +660,11 @@ static bool fl_mask_put(struct cls_fl_head *head, struct fl_flow_mask *mask)
 
 	spin_lock(&head->masks_lock);
 	list_del_rcu(&mask->list);
+	head->nr_masks--;
 	spin_unlock(&head->masks_lock);
 
+	/* the old cache may still point at the mask */
+	fl_cache_drop(head);
 	tcf_queue_work(&mask->rwork, fl_mask_free_work);
 
 	return true;
@@ -552,6 +822,7 @@ static int __fl_delete(struct tcf_proto *tp, struct cls_fl_filter *f,
 	list_del_rcu(&f->list);
 	spin_unlock(&tp->lock);
 
+	fl_cache_invalidate(head);
 	*last = fl_mask_put(head, f->mask);
 	if (!tc_skip_hw(f->flags))
 		fl_hw_destroy_filter(tp, f, rtnl_held, extack);
@@ -568,6 +839,7 @@ static void fl_destroy_sleepable(struct work_struct *work)
 						rwork);
 
 	rhashtable_destroy(&head->ht);
+	free_percpu(head->cache_stats);
 	kfree(head);
 	module_put(THIS_MODULE);
 }
@@ -580,6 +852,11 @@ static void fl_destroy(struct tcf_proto *tp, bool rtnl_held,
 	struct cls_fl_filter *f, *next;
 	bool last;
 
+	/* don't rebuild the cache for every mask going away */
+	WRITE_ONCE(head->cache_off, true);
+	cancel_delayed_work_sync(&head->cache_work);
+	fl_cache_drop(head);
+
 	list_for_each_entry_safe(mask, next_mask, &head->masks, list) {
 		list_for_each_entry_safe(f, next, &mask->filters, list) {
 			__fl_delete(tp, f, &last, rtnl_held, extack);
@@ -2008,8 +2285,11 @@ static struct fl_flow_mask *fl_create_new_mask(struct cls_fl_head *head,
 
 	spin_lock(&head->masks_lock);
 	list_add_tail_rcu(&newmask->list, &head->masks);
+	head->nr_masks++;
 	spin_unlock(&head->masks_lock);
 
+	fl_cache_drop(head);
+
 	return newmask;
 
 errout_destroy:
@@ -2295,6 +2575,7 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 		spin_unlock(&tp->lock);
 	}
 
+	fl_cache_invalidate(head);
 	*arg = fnew;
 
 	kfree(tb);
@@ -2308,9 +2589,11 @@ static int fl_change(struct net *net, struct sk_buff *in_skb,
 	spin_unlock(&tp->lock);
 	if (!tc_skip_hw(fnew->flags))
 		fl_hw_destroy_filter(tp, fnew, rtnl_held, NULL);
-	if (in_ht)
+	if (in_ht) {
 		rhashtable_remove_fast(&fnew->mask->ht, &fnew->ht_node,
 				       fnew->mask->filter_ht_params);
+		fl_cache_invalidate(head);
+	}
 errout_mask:
 	fl_mask_put(head, fnew->mask);
 errout:
@@ -3259,6 +3542,42 @@ static int fl_dump_key(struct sk_buff *skb, struct net *net,
 	return -EMSGSIZE;
 }
 
+static int fl_dump_cache_stats(struct sk_buff *skb, struct cls_fl_head *head)
+{
+	u64 hits = 0, misses = 0;
+	int cpu;
+
+	if (!rcu_access_pointer(head->cache))
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		const struct fl_cache_stats *stats;
+		unsigned int start;
+		u64 h, m;
+
+		stats = per_cpu_ptr(head->cache_stats, cpu);
+		do {
+			start = u64_stats_fetch_begin_irq(&stats->syncp);
+			h = u64_stats_read(&stats->hits);
+			m = u64_stats_read(&stats->misses);
+		} while (u64_stats_fetch_retry_irq(&stats->syncp, start));
+
+		hits += h;
+		misses += m;
+	}
+
+	if (!hits && !misses)
+		return 0;
+
+	if (nla_put_u64_64bit(skb, TCA_FLOWER_CACHE_HITS, hits,
+			      TCA_FLOWER_PAD) ||
+	    nla_put_u64_64bit(skb, TCA_FLOWER_CACHE_MISSES, misses,
+			      TCA_FLOWER_PAD))
+		return -EMSGSIZE;
+
+	return 0;
+}
+
 static int fl_dump(struct net *net, struct tcf_proto *tp, void *fh,
 		   struct sk_buff *skb, struct tcmsg *t, bool rtnl_held)
 {
@@ -3300,6 +3619,9 @@ static int fl_dump(struct net *net, struct tcf_proto *tp, void *fh,
 	if (nla_put_u32(skb, TCA_FLOWER_IN_HW_COUNT, f->in_hw_count))
 		goto nla_put_failure;
 
+	if (fl_dump_cache_stats(skb, fl_head_dereference(tp)))
+		goto nla_put_failure;
+
 	if (tcf_exts_dump(skb, &f->exts))
 		goto nla_put_failure;
 
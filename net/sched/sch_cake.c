@@ -196,6 +196,20 @@ struct cake_tin_data {
 	u32	way_collisions;
 }; /* number of tins is small, so size of this struct doesn't matter much */
 
+/* Global shaper state shared by the cake instances attached to the TX queues
+ * of one mq root, each of them charges its packets against the same schedule
+ * without taking any common lock.
+ */
+struct cake_shared {
+	struct list_head	list;
+	struct net_device	*dev;
+	u32			parent;
+	refcount_t		refcnt;
+
+	atomic64_t		time_next_packet ____cacheline_aligned_in_smp;
+	atomic64_t		failsafe_next_packet;
+};
+
 struct cake_sched_data {
 	struct tcf_proto __rcu *filter_list; /* optional external classifier */
 	struct tcf_block *block;
@@ -217,6 +231,7 @@ struct cake_sched_data {
 	u16		rate_shft;
 	ktime_t		time_next_packet;
 	ktime_t		failsafe_next_packet;
+	struct cake_shared *shared;
 	u64		rate_ns;
 	u64		rate_bps;
 	u16		rate_flags;
@@ -260,7 +275,8 @@ enum {
 	CAKE_FLAG_AUTORATE_INGRESS = BIT(1),
 	CAKE_FLAG_INGRESS	   = BIT(2),
 	CAKE_FLAG_WASH		   = BIT(3),
-	CAKE_FLAG_SPLIT_GSO	   = BIT(4)
+	CAKE_FLAG_SPLIT_GSO	   = BIT(4),
+	CAKE_FLAG_MQ_SHARED	   = BIT(5)
 };
 
 /* COBALT operates the Codel and BLUE algorithms in parallel, in order to
@@ -1465,6 +1481,83 @@ static void cake_heapify_up(struct cake_sched_data *q, u16 i)
 	}
 }
 
+/* instances sharing a shaper, protected by RTNL */
+static LIST_HEAD(cake_shared_list);
+
+static int cake_shared_attach(struct Qdisc *sch,
+			      struct netlink_ext_ack *extack)
+{
+	struct cake_sched_data *q = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	u32 parent = TC_H_MAJ(sch->parent);
+	struct cake_shared *s;
+
+	ASSERT_RTNL();
+
+	if (sch->parent == TC_H_ROOT || sch->parent == TC_H_INGRESS) {
+		NL_SET_ERR_MSG(extack,
+			       "Shared shaping needs a per-queue cake under mq");
+		return -EOPNOTSUPP;
+	}
+
+	list_for_each_entry(s, &cake_shared_list, list) {
+		if (s->dev == dev && s->parent == parent) {
+			refcount_inc(&s->refcnt);
+			q->shared = s;
+			return 0;
+		}
+	}
+
+	s = kzalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+	s->dev = dev;
+	s->parent = parent;
+	refcount_set(&s->refcnt, 1);
+	atomic64_set(&s->time_next_packet, ktime_get());
+	atomic64_set(&s->failsafe_next_packet, ktime_get());
+	list_add(&s->list, &cake_shared_list);
+	q->shared = s;
+	return 0;
+}
+
+static void cake_shared_detach(struct cake_sched_data *q)
+{
+	struct cake_shared *s = q->shared;
+
+	ASSERT_RTNL();
+
+	if (!s)
+		return;
+
+	q->shared = NULL;
+	if (refcount_dec_and_test(&s->refcnt)) {
+		list_del(&s->list);
+		kfree(s);
+	}
+}
+
+/* Refresh the cached copy of the shared schedule. */
+static void cake_shared_load(struct cake_sched_data *q)
+{
+	struct cake_shared *s = q->shared;
+
+	if (s) {
+		q->time_next_packet = atomic64_read(&s->time_next_packet);
+		q->failsafe_next_packet =
+			atomic64_read(&s->failsafe_next_packet);
+	}
+}
+
+static void cake_shared_catch_up(atomic64_t *v, ktime_t now)
+{
+	s64 old = atomic64_read(v);
+
+	while (old < now && !atomic64_try_cmpxchg(v, &old, now))
+		;
+}
+
 static int cake_advance_shaper(struct cake_sched_data *q,
 			       struct cake_tin_data *b,
 			       struct sk_buff *skb,
@@ -1488,6 +1581,19 @@ static int cake_advance_shaper(struct cake_sched_data *q,
 				      ktime_add_ns(now, tin_dur)))
 			b->time_next_packet = ktime_add_ns(now, tin_dur);
 
+		if (q->shared) {
+			struct cake_shared *s = q->shared;
+
+			q->time_next_packet =
+				atomic64_add_return(global_dur,
+						    &s->time_next_packet);
+			if (!drop)
+				q->failsafe_next_packet =
+					atomic64_add_return(failsafe_dur,
+							    &s->failsafe_next_packet);
+			return len;
+		}
+
 		q->time_next_packet = ktime_add_ns(q->time_next_packet,
 						   global_dur);
 		if (!drop)
@@ -1720,6 +1826,15 @@ static s32 cake_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 			b->time_next_packet = now;
 
 		if (!sch->q.qlen) {
+			if (q->shared) {
+				struct cake_shared *s = q->shared;
+
+				cake_shared_catch_up(&s->time_next_packet, now);
+				cake_shared_catch_up(&s->failsafe_next_packet,
+						     now);
+				cake_shared_load(q);
+			}
+
 			if (ktime_before(q->time_next_packet, now)) {
 				q->failsafe_next_packet = now;
 				q->time_next_packet = now;
@@ -1961,6 +2076,7 @@ static struct sk_buff *cake_dequeue(struct Qdisc *sch)
 		return NULL;
 
 	/* global hard shaper */
+	cake_shared_load(q);
 	if (ktime_after(q->time_next_packet, now) &&
 	    ktime_after(q->failsafe_next_packet, now)) {
 		u64 next = min(ktime_to_ns(q->time_next_packet),
@@ -2248,6 +2364,7 @@ static const struct nla_policy cake_policy[TCA_CAKE_MAX + 1] = {
 	[TCA_CAKE_ACK_FILTER]	 = { .type = NLA_U32 },
 	[TCA_CAKE_SPLIT_GSO]	 = { .type = NLA_U32 },
 	[TCA_CAKE_FWMARK]	 = { .type = NLA_U32 },
+	[TCA_CAKE_MQ_SHARED]	 = { .type = NLA_U32 },
 };
 
 static void cake_set_rate(struct cake_tin_data *b, u64 rate, u32 mtu,
@@ -2678,6 +2795,20 @@ static int cake_change(struct Qdisc *sch, struct nlattr *opt,
 		q->fwmark_shft = q->fwmark_mask ? __ffs(q->fwmark_mask) : 0;
 	}
 
+	if (tb[TCA_CAKE_MQ_SHARED]) {
+		bool shared = !!nla_get_u32(tb[TCA_CAKE_MQ_SHARED]);
+
+		if (q->tins && shared != !!q->shared) {
+			NL_SET_ERR_MSG_ATTR(extack, tb[TCA_CAKE_MQ_SHARED],
+					    "Shared shaping can only be set at creation");
+			return -EOPNOTSUPP;
+		}
+		if (shared)
+			q->rate_flags |= CAKE_FLAG_MQ_SHARED;
+		else
+			q->rate_flags &= ~CAKE_FLAG_MQ_SHARED;
+	}
+
 	if (q->tins) {
 		sch_tree_lock(sch);
 		cake_reconfigure(sch);
@@ -2694,6 +2825,7 @@ static void cake_destroy(struct Qdisc *sch)
 	qdisc_watchdog_cancel(&q->watchdog);
 	tcf_block_put(q->block);
 	kvfree(q->tins);
+	cake_shared_detach(q);
 }
 
 static int cake_init(struct Qdisc *sch, struct nlattr *opt,
@@ -2725,6 +2857,12 @@ static int cake_init(struct Qdisc *sch, struct nlattr *opt,
 			return err;
 	}
 
+	if (q->rate_flags & CAKE_FLAG_MQ_SHARED) {
+		err = cake_shared_attach(sch, extack);
+		if (err)
+			return err;
+	}
+
 	err = tcf_block_get(&q->block, &q->filter_list, sch, extack);
 	if (err)
 		return err;
@@ -2836,6 +2974,9 @@ static int cake_dump(struct Qdisc *sch, struct sk_buff *skb)
 	if (nla_put_u32(skb, TCA_CAKE_FWMARK, q->fwmark_mask))
 		goto nla_put_failure;
 
+	if (q->shared && nla_put_u32(skb, TCA_CAKE_MQ_SHARED, 1))
+		goto nla_put_failure;
+
 	return nla_nest_end(skb, opts);
 
 nla_put_failure:
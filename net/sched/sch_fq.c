@@ -28,6 +28,9 @@
  *  Note : When a flow becomes empty, we do not immediately remove it from
  *  rb trees, for performance reasons (its expected to send additional packets,
  *  or SLAB cache will reuse socket for another flow)
+ *
+ *  Throttled flows wait in a hierarchical timing wheel, so that arming and
+ *  releasing them is O(1) whatever the number of paced flows.
  */
 
 #include <linux/module.h>
@@ -80,11 +83,11 @@ struct fq_flow {
 
 /* Second cache line, used in fq_dequeue() */
 	int		credit;
-	/* 32bit hole on 64bit arches */
+	u32		wheel_slot;	/* index in q->wheel when throttled */
 
 	struct fq_flow *next;		/* next pointer in RR lists */
 
-	struct rb_node  rate_node;	/* anchor in q->delayed tree */
+	struct hlist_node wheel_node;	/* anchor in q->wheel */
 	u64		time_next_packet;
 } ____cacheline_aligned_in_smp;
 
@@ -93,12 +96,32 @@ struct fq_flow_head {
 	struct fq_flow *last;
 };
 
+/* Timing wheel for throttled flows.
+ *
+ * Level 0 has FQ_WHEEL_SLOTS slots of 2^FQ_WHEEL_TICK_LOG ns (~1 usec), each
+ * upper level slot covers a whole turn of the level below it, so four levels
+ * reach ~17 seconds, further flows sit in the last slot until they get closer.
+ * A level 0 slot is released once its tick is over, so a flow is never sent
+ * early and at most one tick late, well within the default timer slack.
+ * Upper level slots are cascaded into lower levels when their tick comes.
+ */
+#define FQ_WHEEL_TICK_LOG	10
+#define FQ_WHEEL_LVL_BITS	6
+#define FQ_WHEEL_SLOTS		(1U << FQ_WHEEL_LVL_BITS)
+#define FQ_WHEEL_LEVELS		4
+
+struct fq_wheel {
+	u64			clk;	/* first tick not processed yet */
+	u64			pending[FQ_WHEEL_LEVELS];
+	struct hlist_head	slots[FQ_WHEEL_LEVELS * FQ_WHEEL_SLOTS];
+};
+
 struct fq_sched_data {
 	struct fq_flow_head new_flows;
 
 	struct fq_flow_head old_flows;
 
-	struct rb_root	delayed;	/* for rate limited flows */
+	struct fq_wheel	wheel;		/* for rate limited flows */
 	u64		time_next_delayed_flow;
 	u64		ktime_cache;	/* copy of last ktime_get_ns() */
 	unsigned long	unthrottle_latency_ns;
@@ -169,35 +192,157 @@ static void fq_flow_add_tail(struct fq_flow_head *head, struct fq_flow *flow)
 	flow->next = NULL;
 }
 
+static void fq_wheel_init(struct fq_wheel *w)
+{
+	unsigned int i;
+
+	w->clk = 0;
+	memset(w->pending, 0, sizeof(w->pending));
+	for (i = 0; i < FQ_WHEEL_LEVELS * FQ_WHEEL_SLOTS; i++)
+		INIT_HLIST_HEAD(&w->slots[i]);
+}
+
+static unsigned int fq_wheel_shift(unsigned int lvl)
+{
+	return lvl * FQ_WHEEL_LVL_BITS;
+}
+
+/* Queue @f for tick @t, returns the tick at which its slot is processed. */
+static u64 fq_wheel_add(struct fq_wheel *w, struct fq_flow *f, u64 t)
+{
+	unsigned int lvl, idx;
+
+	if (t < w->clk)
+		t = w->clk;
+
+	for (lvl = 0; lvl < FQ_WHEEL_LEVELS - 1; lvl++) {
+		unsigned int shift = fq_wheel_shift(lvl);
+
+		if ((t >> shift) - (w->clk >> shift) < FQ_WHEEL_SLOTS)
+			break;
+	}
+	if (lvl == FQ_WHEEL_LEVELS - 1) {
+		unsigned int shift = fq_wheel_shift(lvl);
+		u64 last = ((w->clk >> shift) + FQ_WHEEL_SLOTS - 1) << shift;
+
+		t = min(t, last);
+	}
+
+	t >>= fq_wheel_shift(lvl);
+	idx = t & (FQ_WHEEL_SLOTS - 1);
+	f->wheel_slot = lvl * FQ_WHEEL_SLOTS + idx;
+	hlist_add_head(&f->wheel_node, &w->slots[f->wheel_slot]);
+	w->pending[lvl] |= 1ULL << idx;
+
+	return max(t << fq_wheel_shift(lvl), w->clk);
+}
+
+static void fq_wheel_del(struct fq_wheel *w, struct fq_flow *f)
+{
+	unsigned int slot = f->wheel_slot;
+
+	hlist_del(&f->wheel_node);
+	if (hlist_empty(&w->slots[slot]))
+		w->pending[slot / FQ_WHEEL_SLOTS] &=
+			~(1ULL << (slot % FQ_WHEEL_SLOTS));
+}
+
+/* First tick at which a pending slot must be processed, or U64_MAX. */
+static u64 fq_wheel_next(const struct fq_wheel *w)
+{
+	u64 next = U64_MAX;
+	unsigned int lvl;
+
+	for (lvl = 0; lvl < FQ_WHEEL_LEVELS; lvl++) {
+		unsigned int shift = fq_wheel_shift(lvl);
+		u64 base = w->clk >> shift;
+		u64 pending = w->pending[lvl];
+		u64 t;
+
+		if (!pending)
+			continue;
+
+		pending = ror64(pending, base & (FQ_WHEEL_SLOTS - 1));
+		t = (base + __ffs64(pending)) << shift;
+		next = min(next, max(t, w->clk));
+	}
+
+	return next;
+}
+
+static u64 fq_wheel_expires(u64 tick)
+{
+	return tick == U64_MAX ? ~0ULL : (tick + 1) << FQ_WHEEL_TICK_LOG;
+}
+
 static void fq_flow_unset_throttled(struct fq_sched_data *q, struct fq_flow *f)
 {
-	rb_erase(&f->rate_node, &q->delayed);
+	fq_wheel_del(&q->wheel, f);
 	q->throttled_flows--;
 	fq_flow_add_tail(&q->old_flows, f);
 }
 
 static void fq_flow_set_throttled(struct fq_sched_data *q, struct fq_flow *f)
 {
-	struct rb_node **p = &q->delayed.rb_node, *parent = NULL;
+	struct fq_wheel *w = &q->wheel;
+	u64 expires;
 
-	while (*p) {
-		struct fq_flow *aux;
+	/* an idle wheel can jump straight to the current time */
+	if (!q->throttled_flows)
+		w->clk = max(w->clk, q->ktime_cache >> FQ_WHEEL_TICK_LOG);
 
-		parent = *p;
-		aux = rb_entry(parent, struct fq_flow, rate_node);
-		if (f->time_next_packet >= aux->time_next_packet)
-			p = &parent->rb_right;
-		else
-			p = &parent->rb_left;
-	}
-	rb_link_node(&f->rate_node, parent, p);
-	rb_insert_color(&f->rate_node, &q->delayed);
+	expires = fq_wheel_expires(fq_wheel_add(w, f,
+				   f->time_next_packet >> FQ_WHEEL_TICK_LOG));
 	q->throttled_flows++;
 	q->stat_throttled++;
 
 	f->next = &throttled;
-	if (q->time_next_delayed_flow > f->time_next_packet)
-		q->time_next_delayed_flow = f->time_next_packet;
+	if (q->time_next_delayed_flow > expires)
+		q->time_next_delayed_flow = expires;
+}
+
+/* Release all flows whose tick is over, cascading upper levels on the way. */
+static void fq_wheel_run(struct fq_sched_data *q, u64 now)
+{
+	u64 target = now >> FQ_WHEEL_TICK_LOG;
+	struct fq_wheel *w = &q->wheel;
+	struct hlist_head *list;
+	struct hlist_node *tmp;
+	struct fq_flow *f;
+	unsigned int lvl;
+	u64 next;
+
+	while ((next = fq_wheel_next(w)) < target) {
+		w->clk = next;
+
+		for (lvl = FQ_WHEEL_LEVELS - 1; lvl > 0; lvl--) {
+			unsigned int idx, slot;
+			HLIST_HEAD(head);
+
+			idx = (next >> fq_wheel_shift(lvl)) & (FQ_WHEEL_SLOTS - 1);
+			if (!(w->pending[lvl] & (1ULL << idx)))
+				continue;
+
+			slot = lvl * FQ_WHEEL_SLOTS + idx;
+			hlist_move_list(&w->slots[slot], &head);
+			w->pending[lvl] &= ~(1ULL << idx);
+
+			hlist_for_each_entry_safe(f, tmp, &head, wheel_node) {
+				hlist_del(&f->wheel_node);
+				fq_wheel_add(w, f, f->time_next_packet >>
+						   FQ_WHEEL_TICK_LOG);
+			}
+		}
+
+		list = &w->slots[next & (FQ_WHEEL_SLOTS - 1)];
+		hlist_for_each_entry_safe(f, tmp, list, wheel_node)
+			fq_flow_unset_throttled(q, f);
+
+		w->clk = next + 1;
+	}
+
+	w->clk = max(w->clk, target);
+	q->time_next_delayed_flow = fq_wheel_expires(next);
 }
 
 
@@ -499,7 +644,6 @@ static int fq_enqueue(struct sk_buff *skb, struct Qdisc *sch,
 static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 {
 	unsigned long sample;
-	struct rb_node *p;
 
 	if (q->time_next_delayed_flow > now)
 		return;
@@ -511,16 +655,7 @@ static void fq_check_throttled(struct fq_sched_data *q, u64 now)
 	q->unthrottle_latency_ns -= q->unthrottle_latency_ns >> 3;
 	q->unthrottle_latency_ns += sample >> 3;
 
-	q->time_next_delayed_flow = ~0ULL;
-	while ((p = rb_first(&q->delayed)) != NULL) {
-		struct fq_flow *f = rb_entry(p, struct fq_flow, rate_node);
-
-		if (f->time_next_packet > now) {
-			q->time_next_delayed_flow = f->time_next_packet;
-			break;
-		}
-		fq_flow_unset_throttled(q, f);
-	}
+	fq_wheel_run(q, now);
 }
 
 static struct sk_buff *fq_dequeue(struct Qdisc *sch)
@@ -688,7 +823,8 @@ static void fq_reset(struct Qdisc *sch)
 	}
 	q->new_flows.first	= NULL;
 	q->old_flows.first	= NULL;
-	q->delayed		= RB_ROOT;
+	fq_wheel_init(&q->wheel);
+	q->time_next_delayed_flow = ~0ULL;
 	q->flows		= 0;
 	q->inactive_flows	= 0;
 	q->throttled_flows	= 0;
@@ -939,7 +1075,7 @@ static int fq_init(struct Qdisc *sch, struct nlattr *opt,
 	q->rate_enable		= 1;
 	q->new_flows.first	= NULL;
 	q->old_flows.first	= NULL;
-	q->delayed		= RB_ROOT;
+	fq_wheel_init(&q->wheel);
 	q->fq_root		= NULL;
 	q->fq_trees_log		= ilog2(1024);
 	q->orphan_mask		= 1024 - 1;
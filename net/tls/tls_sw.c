@@ -46,6 +46,11 @@
 
 #include "tls.h"
 
+static bool parallel_crypto __read_mostly;
+module_param(parallel_crypto, bool, 0644);
+MODULE_PARM_DESC(parallel_crypto,
+		 "Spread software record crypto of a socket across CPUs using pcrypt");
+
 struct tls_decrypt_arg {
 	struct_group(inargs,
 	bool zc;
@@ -2460,6 +2465,33 @@ void tls_update_rx_zc_capable(struct tls_context *tls_ctx)
 		tls_ctx->prot_info.version != TLS_1_3_VERSION;
 }
 
+/* With parallel_crypto set, wrap the software AEAD in pcrypt so that the
+ * records of one socket are encrypted/decrypted by padata workers on all
+ * CPUs. padata serializes the completions back in submission order, and the
+ * async TX/RX paths already keep records in sequence, so a single large
+ * transfer can use more than one core. Fall back to the plain cipher when
+ * pcrypt is not available.
+ */
+static struct crypto_aead *tls_sw_alloc_aead(const char *cipher_name,
+					     bool *parallel)
+{
+	char pname[CRYPTO_MAX_ALG_NAME];
+	struct crypto_aead *aead;
+
+	*parallel = false;
+	if (READ_ONCE(parallel_crypto) && num_online_cpus() > 1 &&
+	    snprintf(pname, sizeof(pname), "pcrypt(%s)",
+		     cipher_name) < sizeof(pname)) {
+		aead = crypto_alloc_aead(pname, 0, 0);
+		if (!IS_ERR(aead)) {
+			*parallel = true;
+			return aead;
+		}
+	}
+
+	return crypto_alloc_aead(cipher_name, 0, 0);
+}
+
 int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 {
 	struct tls_context *tls_ctx = tls_get_ctx(sk);
@@ -2472,6 +2504,7 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 	u16 nonce_size, tag_size, iv_size, rec_seq_size, salt_size;
 	struct crypto_tfm *tfm;
 	char *iv, *rec_seq, *key, *salt, *cipher_name;
+	bool parallel;
 	size_t keysize;
 	int rc = 0;
 
@@ -2675,12 +2708,17 @@ int tls_set_sw_offload(struct sock *sk, struct tls_context *ctx, int tx)
 	}
 
 	if (!*aead) {
-		*aead = crypto_alloc_aead(cipher_name, 0, 0);
+		*aead = tls_sw_alloc_aead(cipher_name, &parallel);
 		if (IS_ERR(*aead)) {
 			rc = PTR_ERR(*aead);
 			*aead = NULL;
 			goto free_rec_seq;
 		}
+		/* Don't start with a zero-copy record that would be handed
+		 * to a padata worker while the user pages are still live.
+		 */
+		if (sw_ctx_tx && parallel)
+			sw_ctx_tx->async_capable = 1;
 	}
 
 	ctx->push_pending_record = tls_sw_push_pending_record;
@@ -568,6 +568,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 #if IS_ENABLED(CONFIG_AF_UNIX_OOB)
 	if (u->oob_skb) {
@@ -2112,6 +2113,50 @@ static int queue_oob(struct socket *sock, struct msghdr *msg, struct sock *other
 }
 #endif
 
+/* Build an skb whose frags point straight at the sender's pinned user
+ * pages.  The receiver copies out of them and the last reference to the
+ * skb completes the notification on the sender's error queue, so a
+ * large transfer costs one copy instead of two.
+ */
+static struct sk_buff *unix_stream_zerocopy_skb(struct sock *sk,
+						struct msghdr *msg,
+						struct ubuf_info *uarg,
+						struct scm_cookie *scm,
+						bool send_fds, int size,
+						int *err)
+{
+	struct sk_buff *skb;
+
+	size = min_t(int, size, (MAX_SKB_FRAGS - 1) * PAGE_SIZE);
+
+	skb = sock_alloc_send_pskb(sk, 0, 0, msg->msg_flags & MSG_DONTWAIT,
+				   err, 0);
+	if (!skb)
+		return NULL;
+
+	*err = unix_scm_to_skb(scm, skb, send_fds);
+	if (*err < 0)
+		goto free_skb;
+
+	/* Page references are charged to sk_wmem_alloc through skb->sk,
+	 * which is exactly what sock_wfree() gives back.
+	 */
+	*err = __zerocopy_sg_from_iter(msg, NULL, skb, &msg->msg_iter, size);
+	if (*err == -EMSGSIZE && skb->len)
+		*err = 0;	/* ran out of frags, send what we have */
+	if (*err) {
+		iov_iter_revert(&msg->msg_iter, skb->len);
+		goto free_skb;
+	}
+
+	skb_zcopy_set(skb, uarg, NULL);
+	return skb;
+
+free_skb:
+	kfree_skb(skb);
+	return NULL;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
@@ -2122,6 +2167,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	int sent = 0;
 	struct scm_cookie scm;
 	bool fds_sent = false;
+	struct ubuf_info *uarg = NULL;
 	int data_len;
 
 	wait_for_unix_gc();
@@ -2152,12 +2198,35 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if ((msg->msg_flags & MSG_ZEROCOPY) && len &&
+	    sock_flag(sk, SOCK_ZEROCOPY)) {
+		/* Without the socket lock there is nobody to serialise
+		 * extending a previous uarg, so every call gets its own
+		 * notification id.
+		 */
+		uarg = msg_zerocopy_realloc(sk, len, NULL);
+		if (!uarg) {
+			err = -ENOBUFS;
+			goto out_err;
+		}
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		/* Keep two messages in the pipe so it schedules better */
 		size = min_t(int, size, (sk->sk_sndbuf >> 1) - 64);
 
+		if (uarg) {
+			skb = unix_stream_zerocopy_skb(sk, msg, uarg, &scm,
+						       !fds_sent, size, &err);
+			if (!skb)
+				goto out_err;
+			fds_sent = true;
+			size = skb->len;
+			goto queue;
+		}
+
 		/* allow fallback to order-0 allocations */
 		size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
 
@@ -2188,6 +2257,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			goto out_err;
 		}
 
+queue:
 		unix_state_lock(other);
 
 		if (sock_flag(other, SOCK_DEAD) ||
@@ -2211,6 +2281,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	}
 #endif
 
+	net_zcopy_put(uarg);
 	scm_destroy(&scm);
 
 	return sent;
@@ -2223,6 +2294,10 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		send_sig(SIGPIPE, current, 0);
 	err = -EPIPE;
 out_err:
+	if (sent)
+		net_zcopy_put(uarg);
+	else
+		net_zcopy_put_abort(uarg, true);
 	scm_destroy(&scm);
 	return sent ? : err;
 }
@@ -2288,7 +2363,7 @@ static ssize_t unix_stream_sendpage(struct socket *socket, struct page *page,
 	skb = skb_peek_tail(&other->sk_receive_queue);
 	if (tail && tail == skb) {
 		skb = newskb;
-	} else if (!skb || !unix_skb_scm_eq(skb, &scm)) {
+	} else if (!skb || !unix_skb_scm_eq(skb, &scm) || skb_zcopy(skb)) {
 		if (newskb) {
 			skb = newskb;
 		} else {
@@ -2922,11 +2997,19 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.size = size,
 		.flags = flags
 	};
-
-#ifdef CONFIG_BPF_SYSCALL
 	struct sock *sk = sock->sk;
-	const struct proto *prot = READ_ONCE(sk->sk_prot);
+#ifdef CONFIG_BPF_SYSCALL
+	const struct proto *prot;
+#endif
 
+	/* MSG_ZEROCOPY completions, reported like the inet ones so the
+	 * same userspace can parse them.
+	 */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sk, msg, size, SOL_IP, IP_RECVERR);
+
+#ifdef CONFIG_BPF_SYSCALL
+	prot = READ_ONCE(sk->sk_prot);
 	if (prot != &unix_stream_proto)
 		return prot->recvmsg(sk, msg, size, flags, NULL);
 #endif
@@ -2937,6 +3020,12 @@ static int unix_stream_splice_actor(struct sk_buff *skb,
 				    int skip, int chunk,
 				    struct unix_stream_read_state *state)
 {
+	/* The pipe would keep the sender's pages long after the
+	 * completion was reported, so take a private copy first.
+	 */
+	if (unlikely(skb_orphan_frags_rx(skb, GFP_KERNEL)))
+		return -ENOMEM;
+
 	return skb_splice_bits(skb, state->socket->sk,
 			       UNIXCB(skb).consumed + skip,
 			       state->pipe, chunk, state->splice_flags);
@@ -3136,7 +3225,7 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	mask = 0;
 
 	/* exceptional events? */
-	if (sk->sk_err)
+	if (sk->sk_err || !skb_queue_empty_lockless(&sk->sk_error_queue))
 		mask |= EPOLLERR;
 	if (sk->sk_shutdown == SHUTDOWN_MASK)
 		mask |= EPOLLHUP;
@@ -512,6 +512,9 @@ static int xfrm_output_one(struct sk_buff *skb, int err)
 			goto error_nolock;
 		}
 
+		if (xfrm_replay_overflow_cached(x, skb))
+			goto unlocked;
+
 		spin_lock_bh(&x->lock);
 
 		if (unlikely(x->km.state != XFRM_STATE_VALID)) {
@@ -520,6 +523,7 @@ static int xfrm_output_one(struct sk_buff *skb, int err)
 			goto error;
 		}
 
+		xfrm_state_fold_cpu(x);
 		err = xfrm_state_check_expire(x);
 		if (err) {
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATEEXPIRED);
@@ -531,12 +535,14 @@ static int xfrm_output_one(struct sk_buff *skb, int err)
 			XFRM_INC_STATS(net, LINUX_MIB_XFRMOUTSTATESEQERROR);
 			goto error;
 		}
+		xfrm_replay_reserve(x);
 
 		x->curlft.bytes += skb->len;
 		x->curlft.packets++;
 		x->curlft.use_time = ktime_get_real_seconds();
 
 		spin_unlock_bh(&x->lock);
+unlocked:
 
 		skb_dst_force(skb);
 		if (!skb_dst(skb)) {
@@ -28,6 +28,7 @@
 #include <linux/cpu.h>
 #include <linux/audit.h>
 #include <linux/rhashtable.h>
+#include <linux/sort.h>
 #include <linux/if_tunnel.h>
 #include <net/dst.h>
 #include <net/flow.h>
@@ -111,6 +112,55 @@ struct xfrm_pol_inexact_node {
  * the lowest priority.  If two results have same prio, youngest one wins.
  */
 
+/* Compiled classifier for large bins (tuple space search):
+ * the policies of a bin are grouped by selector shape (address prefix
+ * lengths, port masks, protocol set or not).  Each group is a hash table
+ * keyed by the masked selector, with chains sorted by priority, and the
+ * groups are probed in order of their best priority so the search stops
+ * as soon as no remaining group can beat the current result.
+ *
+ * It is built by policy_tss_work once the SPD has been quiet for a while,
+ * or at the latest XFRM_POL_TSS_MAX_DELAY after the first change, and
+ * thrown away whenever the policy set of its bin changes; lookups fall
+ * back to the candidate lists until it is rebuilt.
+ */
+#define XFRM_POL_TSS_NONE	U32_MAX
+#define XFRM_POL_TSS_DELAY	(HZ / 10)
+#define XFRM_POL_TSS_MAX_DELAY	HZ
+
+struct xfrm_pol_tss_key {
+	xfrm_address_t daddr;
+	xfrm_address_t saddr;
+	__be16 dport;
+	__be16 sport;
+	u8 proto;
+};
+
+struct xfrm_pol_tss_rule {
+	struct xfrm_pol_tss_key key;
+	u32 next;
+	struct xfrm_policy *pol;
+};
+
+struct xfrm_pol_tss_tuple {
+	u8 prefixlen_d;
+	u8 prefixlen_s;
+	u8 proto_mask;
+	__be16 dport_mask;
+	__be16 sport_mask;
+	/* priority of the first rule, the best one in this tuple */
+	u32 priority;
+	u32 hmask;
+	u32 *buckets;
+	struct xfrm_pol_tss_rule *rules;
+};
+
+struct xfrm_pol_tss {
+	struct rcu_head rcu;
+	unsigned int ntuples;
+	struct xfrm_pol_tss_tuple tuples[];
+};
+
 struct xfrm_pol_inexact_key {
 	possible_net_t net;
 	u32 if_id;
@@ -131,6 +181,10 @@ struct xfrm_pol_inexact_bin {
 	/* tree sorted by saddr/prefix */
 	struct rb_root root_s;
 
+	/* compiled classifier, replaces the above if present */
+	struct xfrm_pol_tss __rcu *tss;
+	unsigned int tss_genid;
+
 	/* slow path below */
 	struct list_head inexact_bins;
 	struct rcu_head rcu;
@@ -1083,6 +1137,333 @@ static void xfrm_policy_inexact_gc_tree(struct rb_root *r, bool rm)
 	}
 }
 
+static void xfrm_pol_tss_prefix(xfrm_address_t *dst, const xfrm_address_t *src,
+				u8 prefixlen, u16 family)
+{
+	switch (family) {
+	case AF_INET:
+		dst->a4 = src->a4 & inet_make_mask(prefixlen);
+		break;
+	case AF_INET6:
+		ipv6_addr_prefix(&dst->in6, &src->in6, prefixlen);
+		break;
+	}
+}
+
+static u32 xfrm_pol_tss_key(struct xfrm_pol_tss_key *key,
+			    const struct xfrm_pol_tss_tuple *t,
+			    const xfrm_address_t *daddr,
+			    const xfrm_address_t *saddr,
+			    __be16 dport, __be16 sport, u8 proto, u16 family)
+{
+	memset(key, 0, sizeof(*key));
+	xfrm_pol_tss_prefix(&key->daddr, daddr, t->prefixlen_d, family);
+	xfrm_pol_tss_prefix(&key->saddr, saddr, t->prefixlen_s, family);
+	key->dport = dport & t->dport_mask;
+	key->sport = sport & t->sport_mask;
+	key->proto = proto & t->proto_mask;
+
+	return jhash2((const u32 *)key, sizeof(*key) / sizeof(u32), 0) &
+	       t->hmask;
+}
+
+static u64 xfrm_pol_tss_shape(const struct xfrm_selector *sel)
+{
+	return (u64)sel->prefixlen_d << 48 | (u64)sel->prefixlen_s << 40 |
+	       (u64)(sel->proto ? 0xff : 0) << 32 |
+	       (u64)ntohs(sel->dport_mask) << 16 | ntohs(sel->sport_mask);
+}
+
+static int xfrm_pol_tss_cmp(const void *a, const void *b)
+{
+	const struct xfrm_policy *p = *(const struct xfrm_policy **)a;
+	const struct xfrm_policy *q = *(const struct xfrm_policy **)b;
+	u64 x = xfrm_pol_tss_shape(&p->selector);
+	u64 y = xfrm_pol_tss_shape(&q->selector);
+
+	if (x != y)
+		return x < y ? -1 : 1;
+	if (p->priority != q->priority)
+		return p->priority < q->priority ? -1 : 1;
+	if (p->pos != q->pos)
+		return p->pos < q->pos ? -1 : 1;
+	return 0;
+}
+
+static int xfrm_pol_tss_tuple_cmp(const void *a, const void *b)
+{
+	const struct xfrm_pol_tss_tuple *s = a, *t = b;
+
+	if (s->priority != t->priority)
+		return s->priority < t->priority ? -1 : 1;
+	return 0;
+}
+
+/* pols are held by the caller, the result does not take references:
+ * it is unpublished under xfrm_policy_lock before any of them is unlinked.
+ */
+static struct xfrm_pol_tss *xfrm_pol_tss_build(struct xfrm_policy **pols,
+					       unsigned int n, u16 family)
+{
+	struct xfrm_pol_tss_rule *rule;
+	unsigned int i, j, k, ntuples;
+	size_t nbuckets, size;
+	struct xfrm_pol_tss *tss;
+	u32 *bucket;
+
+	sort(pols, n, sizeof(*pols), xfrm_pol_tss_cmp, NULL);
+
+	ntuples = 0;
+	nbuckets = 0;
+	for (i = 0; i < n; i = j) {
+		u64 shape = xfrm_pol_tss_shape(&pols[i]->selector);
+
+		for (j = i + 1; j < n; j++)
+			if (xfrm_pol_tss_shape(&pols[j]->selector) != shape)
+				break;
+		ntuples++;
+		nbuckets += roundup_pow_of_two(j - i);
+	}
+
+	size = struct_size(tss, tuples, ntuples);
+	size = size_add(size, array_size(n, sizeof(*rule)));
+	size = size_add(size, array_size(nbuckets, sizeof(*bucket)));
+	tss = kvzalloc(size, GFP_KERNEL);
+	if (!tss)
+		return NULL;
+
+	tss->ntuples = ntuples;
+	rule = (struct xfrm_pol_tss_rule *)&tss->tuples[ntuples];
+	bucket = (u32 *)(rule + n);
+
+	for (i = 0, ntuples = 0; i < n; i = j, ntuples++) {
+		const struct xfrm_selector *sel = &pols[i]->selector;
+		struct xfrm_pol_tss_tuple *t = &tss->tuples[ntuples];
+		u64 shape = xfrm_pol_tss_shape(sel);
+
+		for (j = i + 1; j < n; j++)
+			if (xfrm_pol_tss_shape(&pols[j]->selector) != shape)
+				break;
+
+		t->prefixlen_d = sel->prefixlen_d;
+		t->prefixlen_s = sel->prefixlen_s;
+		t->proto_mask = sel->proto ? 0xff : 0;
+		t->dport_mask = sel->dport_mask;
+		t->sport_mask = sel->sport_mask;
+		t->priority = pols[i]->priority;
+		t->hmask = roundup_pow_of_two(j - i) - 1;
+		t->rules = rule;
+		t->buckets = bucket;
+		memset(bucket, 0xff, (t->hmask + 1) * sizeof(*bucket));
+
+		/* insert backwards so every chain keeps the priority order */
+		for (k = j; k-- > i; ) {
+			struct xfrm_pol_tss_rule *r = &rule[k - i];
+			u32 h;
+
+			sel = &pols[k]->selector;
+			h = xfrm_pol_tss_key(&r->key, t, &sel->daddr,
+					     &sel->saddr, sel->dport,
+					     sel->sport, sel->proto, family);
+			r->pol = pols[k];
+			r->next = bucket[h];
+			bucket[h] = k - i;
+		}
+
+		rule += j - i;
+		bucket += t->hmask + 1;
+	}
+
+	sort(tss->tuples, ntuples, sizeof(tss->tuples[0]),
+	     xfrm_pol_tss_tuple_cmp, NULL);
+
+	return tss;
+}
+
+static unsigned int xfrm_pol_tss_collect_list(struct hlist_head *head,
+					      struct xfrm_policy **pols,
+					      unsigned int n)
+{
+	struct xfrm_policy *pol;
+
+	hlist_for_each_entry(pol, head, bydst) {
+		if (pols) {
+			xfrm_pol_hold(pol);
+			pols[n] = pol;
+		}
+		n++;
+	}
+
+	return n;
+}
+
+/* count the policies of a bin, or grab them if pols is set */
+static unsigned int xfrm_pol_tss_collect(struct xfrm_pol_inexact_bin *b,
+					 struct xfrm_policy **pols)
+{
+	struct xfrm_pol_inexact_node *node, *snode;
+	struct rb_node *rn, *srn;
+	unsigned int n;
+
+	n = xfrm_pol_tss_collect_list(&b->hhead, pols, 0);
+
+	for (rn = rb_first(&b->root_d); rn; rn = rb_next(rn)) {
+		node = rb_entry(rn, struct xfrm_pol_inexact_node, node);
+		n = xfrm_pol_tss_collect_list(&node->hhead, pols, n);
+
+		for (srn = rb_first(&node->root); srn; srn = rb_next(srn)) {
+			snode = rb_entry(srn, struct xfrm_pol_inexact_node,
+					 node);
+			n = xfrm_pol_tss_collect_list(&snode->hhead, pols, n);
+		}
+	}
+
+	for (rn = rb_first(&b->root_s); rn; rn = rb_next(rn)) {
+		node = rb_entry(rn, struct xfrm_pol_inexact_node, node);
+		n = xfrm_pol_tss_collect_list(&node->hhead, pols, n);
+	}
+
+	return n;
+}
+
+static void xfrm_pol_tss_release(struct xfrm_pol_inexact_bin *b)
+{
+	struct net *net = read_pnet(&b->k.net);
+	struct xfrm_pol_tss *tss;
+
+	tss = rcu_dereference_protected(b->tss,
+					lockdep_is_held(&net->xfrm.xfrm_policy_lock));
+	if (!tss)
+		return;
+
+	RCU_INIT_POINTER(b->tss, NULL);
+	net->xfrm.policy_tss_nr--;
+	kvfree_rcu(tss, rcu);
+}
+
+static void xfrm_policy_tss_schedule(struct net *net)
+{
+	unsigned long deadline;
+	long delay;
+
+	if (!READ_ONCE(net->xfrm.sysctl_policy_tss_min))
+		return;
+
+	/* push the rebuild back while the SPD changes, but no further than
+	 * XFRM_POL_TSS_MAX_DELAY past the first change (0 means none)
+	 */
+	deadline = READ_ONCE(net->xfrm.policy_tss_deadline);
+	if (!deadline) {
+		deadline = (jiffies + XFRM_POL_TSS_MAX_DELAY) ?: 1;
+		WRITE_ONCE(net->xfrm.policy_tss_deadline, deadline);
+	}
+
+	delay = min_t(long, XFRM_POL_TSS_DELAY, deadline - jiffies);
+	mod_delayed_work(system_wq, &net->xfrm.policy_tss_work,
+			 max(delay, 0L));
+}
+
+/* Called under xfrm_policy_lock before the policy set of any bin changes. */
+static void xfrm_policy_tss_invalidate(struct net *net)
+{
+	struct xfrm_pol_inexact_bin *bin;
+
+	lockdep_assert_held(&net->xfrm.xfrm_policy_lock);
+
+	net->xfrm.policy_tss_genid++;
+
+	if (net->xfrm.policy_tss_nr) {
+		list_for_each_entry(bin, &net->xfrm.inexact_bins, inexact_bins)
+			xfrm_pol_tss_release(bin);
+	}
+
+	xfrm_policy_tss_schedule(net);
+}
+
+/* Called under xfrm_policy_lock when an inexact policy is linked to or
+ * unlinked from its bin, the other bins keep their classifiers.
+ */
+static void xfrm_policy_tss_invalidate_pol(struct xfrm_policy *pol, int dir)
+{
+	struct net *net = xp_net(pol);
+	struct xfrm_pol_inexact_bin *bin;
+
+	bin = xfrm_policy_inexact_lookup(net, pol->type, pol->family, dir,
+					 pol->if_id);
+	if (bin) {
+		bin->tss_genid++;
+		xfrm_pol_tss_release(bin);
+	}
+
+	xfrm_policy_tss_schedule(net);
+}
+
+static void xfrm_policy_tss_work(struct work_struct *work)
+{
+	struct net *net = container_of(work, struct net,
+				       xfrm.policy_tss_work.work);
+	unsigned int genid, bin_genid, min, max, n;
+	struct xfrm_pol_inexact_bin *bin;
+	struct xfrm_policy **pols;
+	struct xfrm_pol_tss *tss;
+	int dir;
+
+	WRITE_ONCE(net->xfrm.policy_tss_deadline, 0);
+
+	min = READ_ONCE(net->xfrm.sysctl_policy_tss_min);
+	if (!min)
+		return;
+
+	max = 0;
+	for (dir = 0; dir < XFRM_POLICY_MAX; dir++)
+		max += READ_ONCE(net->xfrm.policy_count[dir]);
+	if (max < min)
+		return;
+
+	pols = kvmalloc_array(max, sizeof(*pols), GFP_KERNEL);
+	if (!pols)
+		return;
+
+	spin_lock_bh(&net->xfrm.xfrm_policy_lock);
+	genid = net->xfrm.policy_tss_genid;
+	list_for_each_entry(bin, &net->xfrm.inexact_bins, inexact_bins) {
+		if (rcu_access_pointer(bin->tss))
+			continue;
+
+		n = xfrm_pol_tss_collect(bin, NULL);
+		if (n < min || n > max)
+			continue;
+
+		xfrm_pol_tss_collect(bin, pols);
+		bin_genid = bin->tss_genid;
+		spin_unlock_bh(&net->xfrm.xfrm_policy_lock);
+
+		tss = xfrm_pol_tss_build(pols, n, bin->k.family);
+
+		spin_lock_bh(&net->xfrm.xfrm_policy_lock);
+		if (genid != net->xfrm.policy_tss_genid) {
+			/* bin may be gone, a new run is already queued */
+			spin_unlock_bh(&net->xfrm.xfrm_policy_lock);
+			kvfree(tss);
+			xfrm_pols_put(pols, n);
+			goto out;
+		}
+
+		if (tss && bin_genid != bin->tss_genid) {
+			/* the bin changed meanwhile, a new run is queued */
+			kvfree(tss);
+		} else if (tss) {
+			rcu_assign_pointer(bin->tss, tss);
+			net->xfrm.policy_tss_nr++;
+		}
+		/* still linked, these can not be the last references */
+		xfrm_pols_put(pols, n);
+	}
+	spin_unlock_bh(&net->xfrm.xfrm_policy_lock);
+out:
+	kvfree(pols);
+}
+
 static void __xfrm_policy_inexact_prune_bin(struct xfrm_pol_inexact_bin *b, bool net_exit)
 {
 	write_seqcount_begin(&b->count);
@@ -1098,6 +1479,8 @@ static void __xfrm_policy_inexact_prune_bin(struct xfrm_pol_inexact_bin *b, bool
 
 	if (rhashtable_remove_fast(&xfrm_policy_inexact_table, &b->head,
 				   xfrm_pol_inexact_params) == 0) {
+		xfrm_pol_tss_release(b);
+		read_pnet(&b->k.net)->xfrm.policy_tss_genid++;
 		list_del(&b->inexact_bins);
 		kfree_rcu(b, rcu);
 	}
@@ -1247,6 +1630,7 @@ static void xfrm_hash_rebuild(struct work_struct *work)
 
 	spin_lock_bh(&net->xfrm.xfrm_policy_lock);
 	write_seqcount_begin(&net->xfrm.xfrm_policy_hash_generation);
+	xfrm_policy_tss_invalidate(net);
 
 	/* make sure that we can insert the indirect policies again before
 	 * we start with destructive action.
@@ -2074,6 +2458,77 @@ xfrm_policy_eval_candidates(struct xfrm_pol_inexact_candidates *cand,
 	return prefer;
 }
 
+static struct xfrm_policy *
+xfrm_policy_eval_tss(const struct xfrm_pol_tss *tss,
+		     struct xfrm_policy *prefer,
+		     const struct flowi *fl,
+		     const xfrm_address_t *saddr, const xfrm_address_t *daddr,
+		     u8 type, u16 family, int dir, u32 if_id)
+{
+	u32 priority = prefer ? prefer->priority : ~0u;
+	const union flowi_uli *uli;
+	struct xfrm_pol_tss_key key;
+	__be16 dport, sport;
+	unsigned int i;
+
+	switch (family) {
+	case AF_INET:
+		uli = &fl->u.ip4.uli;
+		break;
+	case AF_INET6:
+		uli = &fl->u.ip6.uli;
+		break;
+	default:
+		return prefer;
+	}
+
+	dport = xfrm_flowi_dport(fl, uli);
+	sport = xfrm_flowi_sport(fl, uli);
+
+	for (i = 0; i < tss->ntuples; i++) {
+		const struct xfrm_pol_tss_tuple *t = &tss->tuples[i];
+		const struct xfrm_pol_tss_rule *r;
+		u32 idx;
+
+		if (t->priority > priority)
+			break;
+
+		idx = xfrm_pol_tss_key(&key, t, daddr, saddr, dport, sport,
+				       fl->flowi_proto, family);
+		for (idx = t->buckets[idx]; idx != XFRM_POL_TSS_NONE;
+		     idx = r->next) {
+			struct xfrm_policy *pol;
+			int err;
+
+			r = &t->rules[idx];
+			pol = r->pol;
+			if (pol->priority > priority)
+				break;
+			if (memcmp(&r->key, &key, sizeof(key)))
+				continue;
+
+			err = xfrm_policy_match(pol, fl, type, family, dir,
+						if_id);
+			if (err) {
+				if (err != -ESRCH)
+					return ERR_PTR(err);
+
+				continue;
+			}
+
+			/* matches.  Is it older than *prefer? */
+			if (!prefer || pol->priority < priority ||
+			    prefer->pos >= pol->pos) {
+				prefer = pol;
+				priority = pol->priority;
+			}
+			break;
+		}
+	}
+
+	return prefer;
+}
+
 static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 						     const struct flowi *fl,
 						     u16 family, u8 dir,
@@ -2083,6 +2538,7 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 	const xfrm_address_t *daddr, *saddr;
 	struct xfrm_pol_inexact_bin *bin;
 	struct xfrm_policy *pol, *ret;
+	const struct xfrm_pol_tss *tss;
 	struct hlist_head *chain;
 	unsigned int sequence;
 	int err;
@@ -2115,12 +2571,21 @@ static struct xfrm_policy *xfrm_policy_lookup_bytype(struct net *net, u8 type,
 		}
 	}
 	bin = xfrm_policy_inexact_lookup_rcu(net, type, family, dir, if_id);
-	if (!bin || !xfrm_policy_find_inexact_candidates(&cand, bin, saddr,
-							 daddr))
+	if (!bin)
 		goto skip_inexact;
 
-	pol = xfrm_policy_eval_candidates(&cand, ret, fl, type,
-					  family, dir, if_id);
+	tss = rcu_dereference(bin->tss);
+	if (tss) {
+		pol = xfrm_policy_eval_tss(tss, ret, fl, saddr, daddr, type,
+					   family, dir, if_id);
+	} else {
+		if (!xfrm_policy_find_inexact_candidates(&cand, bin, saddr,
+							 daddr))
+			goto skip_inexact;
+
+		pol = xfrm_policy_eval_candidates(&cand, ret, fl, type,
+						  family, dir, if_id);
+	}
 	if (pol) {
 		ret = pol;
 		if (IS_ERR(pol))
@@ -2202,6 +2667,9 @@ static void __xfrm_policy_link(struct xfrm_policy *pol, int dir)
 {
 	struct net *net = xp_net(pol);
 
+	if (!hlist_unhashed(&pol->bydst_inexact_list))
+		xfrm_policy_tss_invalidate_pol(pol, dir);
+
 	list_add(&pol->walk.all, &net->xfrm.policy_all);
 	net->xfrm.policy_count[dir]++;
 	xfrm_pol_hold(pol);
@@ -2217,6 +2685,8 @@ static struct xfrm_policy *__xfrm_policy_unlink(struct xfrm_policy *pol,
 
 	/* Socket policies are not hashed. */
 	if (!hlist_unhashed(&pol->bydst)) {
+		if (!hlist_unhashed(&pol->bydst_inexact_list))
+			xfrm_policy_tss_invalidate_pol(pol, dir);
 		hlist_del_rcu(&pol->bydst);
 		hlist_del_init(&pol->bydst_inexact_list);
 		hlist_del(&pol->byidx);
@@ -4066,6 +4536,7 @@ static int __net_init xfrm_policy_init(struct net *net)
 	INIT_LIST_HEAD(&net->xfrm.inexact_bins);
 	INIT_WORK(&net->xfrm.policy_hash_work, xfrm_hash_resize);
 	INIT_WORK(&net->xfrm.policy_hthresh.work, xfrm_hash_rebuild);
+	INIT_DELAYED_WORK(&net->xfrm.policy_tss_work, xfrm_policy_tss_work);
 	return 0;
 
 out_bydst:
@@ -4091,6 +4562,7 @@ static void xfrm_policy_fini(struct net *net)
 	xfrm_policy_flush(net, XFRM_POLICY_TYPE_SUB, false);
 #endif
 	xfrm_policy_flush(net, XFRM_POLICY_TYPE_MAIN, false);
+	cancel_delayed_work_sync(&net->xfrm.policy_tss_work);
 
 	WARN_ON(!list_empty(&net->xfrm.policy_all));
 
@@ -118,6 +118,137 @@ static int __xfrm_replay_overflow(struct xfrm_state *x, struct sk_buff *skb)
 	return err;
 }
 
+/* Outbound sequence numbers can be handed out in per-cpu blocks of
+ * net.core.xfrm_oseq_batch numbers, so that a busy SA does not take x->lock
+ * for every packet. Packets from different CPUs then leave out of order by
+ * up to one block per CPU, and lifetime usage is folded into curlft one
+ * block at a time. Only the 32 bit modes without offload are handled.
+ */
+static u32 *xfrm_replay_oseq(struct xfrm_state *x)
+{
+	if (!(x->type->flags & XFRM_TYPE_REPLAY_PROT) || x->xso.dev)
+		return NULL;
+
+	switch (x->repl_mode) {
+	case XFRM_REPLAY_MODE_LEGACY:
+		return &x->replay.oseq;
+	case XFRM_REPLAY_MODE_BMP:
+		return &x->replay_esn->oseq;
+	case XFRM_REPLAY_MODE_ESN:
+		break;
+	}
+
+	return NULL;
+}
+
+/* Called without x->lock, false means the caller has to take it. */
+bool xfrm_replay_overflow_cached(struct xfrm_state *x, struct sk_buff *skb)
+{
+	struct xfrm_state_cpu __percpu *pcpu = smp_load_acquire(&x->pcpu);
+	struct xfrm_state_cpu *pc;
+	time64_t now;
+	bool ret = false;
+
+	if (!pcpu || xfrm_offload(skb))
+		return false;
+
+	local_bh_disable();
+	pc = this_cpu_ptr(pcpu);
+	if (pc->oseq != pc->oseq_end &&
+	    pc->gen == READ_ONCE(x->oseq_gen) &&
+	    READ_ONCE(x->km.state) == XFRM_STATE_VALID) {
+		XFRM_SKB_CB(skb)->seq.output.low = ++pc->oseq;
+		XFRM_SKB_CB(skb)->seq.output.hi = 0;
+		WRITE_ONCE(pc->bytes, pc->bytes + skb->len);
+		WRITE_ONCE(pc->packets, pc->packets + 1);
+		ret = true;
+	}
+	local_bh_enable();
+
+	if (ret) {
+		now = ktime_get_real_seconds();
+		if (READ_ONCE(x->curlft.use_time) != now)
+			WRITE_ONCE(x->curlft.use_time, now);
+	}
+	return ret;
+}
+
+/* Called under x->lock, once the current packet got its number. */
+void xfrm_replay_reserve(struct xfrm_state *x)
+{
+	u32 batch = READ_ONCE(xs_net(x)->xfrm.sysctl_oseq_batch);
+	struct xfrm_state_cpu *pc;
+	u32 *oseq;
+
+	if (batch < 2)
+		return;
+
+	oseq = xfrm_replay_oseq(x);
+	if (!oseq || *oseq + batch - 1 < *oseq)
+		return;
+
+	if (!x->pcpu) {
+		struct xfrm_state_cpu __percpu *pcpu;
+
+		pcpu = alloc_percpu_gfp(struct xfrm_state_cpu, GFP_ATOMIC);
+		if (!pcpu)
+			return;
+		smp_store_release(&x->pcpu, pcpu);
+	}
+
+	pc = this_cpu_ptr(x->pcpu);
+	pc->oseq = *oseq;
+	pc->oseq_end = *oseq + batch - 1;
+	pc->gen = x->oseq_gen;
+	*oseq = pc->oseq_end;
+}
+
+/* Called under x->lock to account the usage of this CPU's block. */
+void xfrm_state_fold_cpu(struct xfrm_state *x)
+{
+	struct xfrm_state_cpu *pc;
+
+	if (!x->pcpu)
+		return;
+
+	pc = this_cpu_ptr(x->pcpu);
+	if (!pc->packets)
+		return;
+
+	write_seqcount_begin(&x->lft_seq);
+	x->curlft.bytes += pc->bytes;
+	x->curlft.packets += pc->packets;
+	WRITE_ONCE(pc->bytes, 0);
+	WRITE_ONCE(pc->packets, 0);
+	write_seqcount_end(&x->lft_seq);
+}
+
+/* Current lifetime of @x, including the usage other CPUs have not folded
+ * yet. Doesn't need x->lock, state dumps call it under xfrm_state_lock.
+ */
+void xfrm_state_curlft(const struct xfrm_state *x,
+		       struct xfrm_lifetime_cur *curlft)
+{
+	struct xfrm_state_cpu __percpu *pcpu = smp_load_acquire(&x->pcpu);
+	unsigned int seq;
+	int cpu;
+
+	do {
+		seq = read_seqcount_begin(&x->lft_seq);
+		*curlft = x->curlft;
+		if (!pcpu)
+			continue;
+
+		for_each_possible_cpu(cpu) {
+			const struct xfrm_state_cpu *pc = per_cpu_ptr(pcpu, cpu);
+
+			curlft->bytes += READ_ONCE(pc->bytes);
+			curlft->packets += READ_ONCE(pc->packets);
+		}
+	} while (read_seqcount_retry(&x->lft_seq, seq));
+}
+EXPORT_SYMBOL(xfrm_state_curlft);
+
 static int xfrm_replay_check_legacy(struct xfrm_state *x,
 				    struct sk_buff *skb, __be32 net_seq)
 {
@@ -10,6 +10,8 @@ static void __net_init __xfrm_sysctl_init(struct net *net)
 	net->xfrm.sysctl_aevent_rseqth = XFRM_AE_SEQT_SIZE;
 	net->xfrm.sysctl_larval_drop = 1;
 	net->xfrm.sysctl_acq_expires = 30;
+	net->xfrm.sysctl_oseq_batch = 0;
+	net->xfrm.sysctl_policy_tss_min = 0;
 }
 
 #ifdef CONFIG_SYSCTL
@@ -38,6 +40,18 @@ static struct ctl_table xfrm_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec
 	},
+	{
+		.procname	= "xfrm_oseq_batch",
+		.maxlen		= sizeof(u32),
+		.mode		= 0644,
+		.proc_handler	= proc_douintvec
+	},
+	{
+		.procname	= "xfrm_policy_tss_min",
+		.maxlen		= sizeof(u32),
+		.mode		= 0644,
+		.proc_handler	= proc_douintvec
+	},
 	{}
 };
 
@@ -54,6 +68,8 @@ int __net_init xfrm_sysctl_init(struct net *net)
 	table[1].data = &net->xfrm.sysctl_aevent_rseqth;
 	table[2].data = &net->xfrm.sysctl_larval_drop;
 	table[3].data = &net->xfrm.sysctl_acq_expires;
+	table[4].data = &net->xfrm.sysctl_oseq_batch;
+	table[5].data = &net->xfrm.sysctl_policy_tss_min;
 
 	/* Don't export sysctls to unprivileged users */
 	if (net->user_ns != &init_user_ns)
@@ -544,6 +544,10 @@ static void xfrm_update_ae_params(struct xfrm_state *x, struct nlattr **attrs,
 		memcpy(&x->preplay, replay, sizeof(*replay));
 	}
 
+	/* drop the sequence numbers reserved from the old counters */
+	if (re || rp)
+		WRITE_ONCE(x->oseq_gen, x->oseq_gen + 1);
+
 	if (lt) {
 		struct xfrm_lifetime_cur *ltime;
 		ltime = nla_data(lt);
@@ -799,7 +803,7 @@ static void copy_to_user_state(struct xfrm_state *x, struct xfrm_usersa_info *p)
 	memcpy(&p->id, &x->id, sizeof(p->id));
 	memcpy(&p->sel, &x->sel, sizeof(p->sel));
 	memcpy(&p->lft, &x->lft, sizeof(p->lft));
-	memcpy(&p->curlft, &x->curlft, sizeof(p->curlft));
+	xfrm_state_curlft(x, &p->curlft);
 	put_unaligned(x->stats.replay_window, &p->stats.replay_window);
 	put_unaligned(x->stats.replay, &p->stats.replay);
 	put_unaligned(x->stats.integrity_failed, &p->stats.integrity_failed);
@@ -2188,6 +2192,7 @@ static inline unsigned int xfrm_aevent_msgsize(struct xfrm_state *x)
 
 static int build_aevent(struct sk_buff *skb, struct xfrm_state *x, const struct km_event *c)
 {
+	struct xfrm_lifetime_cur curlft;
 	struct xfrm_aevent_id *id;
 	struct nlmsghdr *nlh;
 	int err;
@@ -2216,7 +2221,8 @@ static int build_aevent(struct sk_buff *skb, struct xfrm_state *x, const struct
 	}
 	if (err)
 		goto out_cancel;
-	err = nla_put_64bit(skb, XFRMA_LTIME_VAL, sizeof(x->curlft), &x->curlft,
+	xfrm_state_curlft(x, &curlft);
+	err = nla_put_64bit(skb, XFRMA_LTIME_VAL, sizeof(curlft), &curlft,
 			    XFRMA_PAD);
 	if (err)
 		goto out_cancel;
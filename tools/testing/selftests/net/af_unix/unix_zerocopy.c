@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../../kselftest_harness.h"
+
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY	60
+#endif
+
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY	5
+#endif
+
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY	0x4000000
+#endif
+
+#define ZC_CHUNK	(256 * 1024)
+#define ZC_SENDS	8
+
+FIXTURE(unix_zerocopy)
+{
+	int fd[2];
+	char *tx, *rx;
+};
+
+FIXTURE_SETUP(unix_zerocopy)
+{
+	int one = 1, sndbuf = 4 * ZC_CHUNK, i;
+
+	ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, self->fd));
+	ASSERT_EQ(0, setsockopt(self->fd[0], SOL_SOCKET, SO_SNDBUF,
+				&sndbuf, sizeof(sndbuf)));
+	ASSERT_EQ(0, setsockopt(self->fd[0], SOL_SOCKET, SO_ZEROCOPY,
+				&one, sizeof(one)));
+
+	self->tx = malloc(ZC_CHUNK);
+	self->rx = malloc(ZC_CHUNK);
+	ASSERT_NE(NULL, self->tx);
+	ASSERT_NE(NULL, self->rx);
+
+	for (i = 0; i < ZC_CHUNK; i++)
+		self->tx[i] = i * 7;
+}
+
+FIXTURE_TEARDOWN(unix_zerocopy)
+{
+	free(self->tx);
+	free(self->rx);
+	close(self->fd[0]);
+	close(self->fd[1]);
+}
+
+static void read_all(struct __test_metadata *_metadata, int fd,
+		     char *buf, size_t len)
+{
+	size_t off = 0;
+	ssize_t ret;
+
+	while (off < len) {
+		ret = recv(fd, buf + off, len - off, 0);
+		ASSERT_LT(0, ret);
+		off += ret;
+	}
+}
+
+/* Returns the highest completed notification id seen, or -1. */
+static int read_completions(struct __test_metadata *_metadata, int fd)
+{
+	char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+	struct sock_extended_err *serr;
+	struct msghdr msg = {};
+	struct cmsghdr *cm;
+	int hi = -1;
+
+	for (;;) {
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+			ASSERT_EQ(EAGAIN, errno);
+			return hi;
+		}
+
+		cm = CMSG_FIRSTHDR(&msg);
+		ASSERT_NE(NULL, cm);
+		ASSERT_EQ(SOL_IP, cm->cmsg_level);
+		ASSERT_EQ(IP_RECVERR, cm->cmsg_type);
+
+		serr = (void *)CMSG_DATA(cm);
+		ASSERT_EQ(SO_EE_ORIGIN_ZEROCOPY, serr->ee_origin);
+		ASSERT_EQ(0, serr->ee_errno);
+		ASSERT_LE(serr->ee_info, serr->ee_data);
+		if ((int)serr->ee_data > hi)
+			hi = serr->ee_data;
+	}
+}
+
+TEST_F(unix_zerocopy, send_and_complete)
+{
+	int i;
+
+	for (i = 0; i < ZC_SENDS; i++) {
+		ASSERT_EQ(ZC_CHUNK, send(self->fd[0], self->tx, ZC_CHUNK,
+					 MSG_ZEROCOPY));
+		read_all(_metadata, self->fd[1], self->rx, ZC_CHUNK);
+		ASSERT_EQ(0, memcmp(self->tx, self->rx, ZC_CHUNK));
+	}
+
+	/* Every skb has been consumed, so every send must be complete. */
+	ASSERT_EQ(ZC_SENDS - 1, read_completions(_metadata, self->fd[0]));
+}
+
+TEST_F(unix_zerocopy, pending_until_read)
+{
+	ASSERT_EQ(ZC_CHUNK / 2, send(self->fd[0], self->tx, ZC_CHUNK / 2,
+				     MSG_ZEROCOPY));
+
+	/* The receiver still references the pages. */
+	ASSERT_EQ(-1, read_completions(_metadata, self->fd[0]));
+
+	read_all(_metadata, self->fd[1], self->rx, ZC_CHUNK / 2);
+	ASSERT_EQ(0, read_completions(_metadata, self->fd[0]));
+}
+
+TEST(unix_zerocopy_dgram_unsupported)
+{
+	int one = 1, fd;
+
+	fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+	ASSERT_LE(0, fd);
+	ASSERT_EQ(-1, setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY,
+				 &one, sizeof(one)));
+	ASSERT_EQ(EOPNOTSUPP, errno);
+	close(fd);
+}
+
+TEST_HARNESS_MAIN
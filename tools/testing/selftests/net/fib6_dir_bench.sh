@@ -0,0 +1,166 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare IPv6 forwarding rates with and without the direct-indexed first
+# level of the fib6 tree (net.ipv6.route.fib_dir_min_routes), on a large
+# table.
+#
+# The table is either loaded from a route dump, one prefix per line as the
+# first field (e.g. the output of "ip -6 route" or a BGP RIB export), or
+# made of random prefixes in 2000::/3 with a roughly Internet-like length
+# distribution. All routes point at a dummy device. pktgen sends packets
+# with random destinations in 2000::/3 into a veth pair and the forwarded
+# packets are counted on the dummy device.
+#
+# Usage: fib6_dir_bench.sh [-d seconds] [-n prefixes] [-f route dump]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+duration=5
+nprefix=100000
+dump=
+
+while getopts "d:n:f:" o; do
+	case $o in
+	d) duration=$OPTARG ;;
+	n) nprefix=$OPTARG ;;
+	f) dump=$OPTARG ;;
+	*) echo "Usage: $0 [-d seconds] [-n prefixes] [-f route dump]"
+	   exit 1 ;;
+	esac
+done
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-fib6-$sfx"
+pg=/proc/net/pktgen
+
+cleanup() {
+	ip netns del "$ns" 2>/dev/null
+}
+
+if ! command -v ip > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+if ! modprobe -q pktgen 2>/dev/null && [ ! -d $pg ]; then
+	echo "SKIP: pktgen not available"
+	exit $ksft_skip
+fi
+
+if [ -n "$dump" ] && [ ! -r "$dump" ]; then
+	echo "FAIL: cannot read $dump"
+	exit 1
+fi
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+knob=/proc/sys/net/ipv6/route/fib_dir_min_routes
+if ! ip netns exec "$ns" test -w $knob; then
+	echo "SKIP: fib_dir_min_routes sysctl not available"
+	exit $ksft_skip
+fi
+
+ip -net "$ns" link add veth0 type veth peer name veth1
+ip -net "$ns" link add dummy0 type dummy
+ip netns exec "$ns" sysctl -qw net.ipv6.conf.all.forwarding=1
+ip netns exec "$ns" sysctl -qw net.ipv6.conf.default.accept_dad=0
+for dev in veth0 veth1 dummy0; do
+	ip netns exec "$ns" sysctl -qw net.ipv6.conf.$dev.accept_dad=0
+	ip -net "$ns" link set $dev up
+done
+ip -net "$ns" addr add 2001:db8::1/64 dev veth1 nodad
+mac=$(ip netns exec "$ns" cat /sys/class/net/veth1/address)
+
+# /48s dominate real tables, followed by /32-/44 and a few /29-/31.
+gen_prefixes() {
+	awk -v n="$nprefix" 'BEGIN {
+		srand(1);
+		for (i = 0; i < n; i++) {
+			r = rand();
+			if (r < 0.5)
+				len = 48;
+			else if (r < 0.9)
+				len = 32 + 4 * int(rand() * 4);
+			else
+				len = 29 + int(rand() * 3);
+			w[0] = 8192 + int(rand() * 8192);
+			w[1] = int(rand() * 65536);
+			w[2] = int(rand() * 65536);
+			for (j = 0; j < 3; j++) {
+				bits = len - 16 * j;
+				if (bits <= 0)
+					w[j] = 0;
+				else if (bits < 16)
+					w[j] -= w[j] % 2 ^ (16 - bits);
+			}
+			printf "%x:%x:%x::/%d\n", w[0], w[1], w[2], len;
+		}
+	}'
+}
+
+load_table() {
+	local src
+
+	if [ -n "$dump" ]; then
+		src=$(awk '$1 ~ /^[0-9a-fA-F:]+(\/[0-9]+)?$/ { print $1 }' \
+			"$dump")
+	else
+		src=$(gen_prefixes)
+	fi
+
+	echo "$src" | sed 's/.*/route replace & dev dummy0 proto 99/' |
+		ip -6 -net "$ns" -force -batch - 2>/dev/null
+	ip -6 -net "$ns" route replace default dev dummy0 proto 99
+}
+
+# A change of the tree shape drops the current fib6_dir and rebuilds it if
+# the sysctl allows, after a short settling delay.
+set_mode() {
+	ip netns exec "$ns" sh -c "echo $1 > $knob"
+	ip -6 -net "$ns" route add 3fff:ffff::/32 dev dummy0
+	ip -6 -net "$ns" route del 3fff:ffff::/32 dev dummy0
+	sleep 1
+}
+
+run_one() {
+	local stats=/sys/class/net/dummy0/statistics/tx_packets before after
+
+	before=$(ip netns exec "$ns" cat $stats)
+	ip netns exec "$ns" bash -c "
+		echo rem_device_all > $pg/kpktgend_0
+		echo add_device veth0 > $pg/kpktgend_0
+		echo count 0 > $pg/veth0
+		echo pkt_size 96 > $pg/veth0
+		echo src6 2001:db8::2 > $pg/veth0
+		echo dst6 2000:: > $pg/veth0
+		echo dst6_min 2000:: > $pg/veth0
+		echo dst6_max 3fff:ffff:ffff:ffff:ffff:ffff:ffff:ffff > $pg/veth0
+		echo dst_mac $mac > $pg/veth0
+		echo start > $pg/pgctrl &
+		sleep $duration
+		echo stop > $pg/pgctrl
+		wait"
+	after=$(ip netns exec "$ns" cat $stats)
+
+	echo $(((after - before) / duration))
+}
+
+load_table
+routes=$(ip -6 -net "$ns" route show proto 99 | wc -l)
+echo "loaded $routes routes"
+
+printf "%-12s %14s\n" "fib6_dir" "packets/s"
+for mode in 0 1; do
+	set_mode $mode
+	printf "%-12s %14s\n" "$([ $mode -eq 0 ] && echo off || echo on)" \
+		"$(run_one)"
+done
+
+echo "PASS: fib6_dir forwarding benchmark"
+exit 0
@@ -0,0 +1,191 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare IPv4 forwarding rates with and without the direct-indexed first
+# level of fib_trie (net.ipv4.fib_dir_min_leaves), on a large table.
+# Before measuring, check that a sample of lookups matches the same route
+# in both modes.
+#
+# The table is either loaded from a route dump, one prefix per line as the
+# first field (e.g. the output of "ip route" or a BGP RIB export), or made
+# of random prefixes with a roughly Internet-like length distribution. All
+# routes point at a dummy device. pktgen sends packets with random
+# destinations into a veth pair and the forwarded packets are counted on
+# the dummy device.
+#
+# Usage: fib_dir_bench.sh [-d seconds] [-n prefixes] [-f route dump]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+duration=5
+nprefix=100000
+dump=
+
+while getopts "d:n:f:" o; do
+	case $o in
+	d) duration=$OPTARG ;;
+	n) nprefix=$OPTARG ;;
+	f) dump=$OPTARG ;;
+	*) echo "Usage: $0 [-d seconds] [-n prefixes] [-f route dump]"
+	   exit 1 ;;
+	esac
+done
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-fib-$sfx"
+pg=/proc/net/pktgen
+knob=/proc/sys/net/ipv4/fib_dir_min_leaves
+
+cleanup() {
+	ip netns del "$ns" 2>/dev/null
+}
+
+if ! command -v ip > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+if ! modprobe -q pktgen 2>/dev/null && [ ! -d $pg ]; then
+	echo "SKIP: pktgen not available"
+	exit $ksft_skip
+fi
+
+if [ -n "$dump" ] && [ ! -r "$dump" ]; then
+	echo "FAIL: cannot read $dump"
+	exit 1
+fi
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+if ! ip netns exec "$ns" test -w "$knob"; then
+	echo "SKIP: fib_dir_min_leaves sysctl not available"
+	exit $ksft_skip
+fi
+
+ip -net "$ns" link add veth0 type veth peer name veth1
+ip -net "$ns" link add dummy0 type dummy
+for dev in veth0 veth1 dummy0; do
+	ip -net "$ns" link set $dev up
+done
+ip -net "$ns" addr add 192.0.2.1/24 dev veth1
+ip netns exec "$ns" sysctl -qw net.ipv4.ip_forward=1
+ip netns exec "$ns" sysctl -qw net.ipv4.conf.all.rp_filter=0
+ip netns exec "$ns" sysctl -qw net.ipv4.conf.veth1.rp_filter=0
+mac=$(ip netns exec "$ns" cat /sys/class/net/veth1/address)
+
+# /24s dominate real tables, followed by /22-/23 and a tail of shorter ones.
+gen_prefixes() {
+	awk -v n="$nprefix" 'BEGIN {
+		srand(1);
+		for (i = 0; i < n; i++) {
+			r = rand();
+			if (r < 0.6)
+				len = 24;
+			else if (r < 0.8)
+				len = 22 + int(rand() * 2);
+			else
+				len = 16 + int(rand() * 6);
+			a = 1 + int(rand() * 222);
+			addr = a * 16777216 + int(rand() * 16777216);
+			addr -= addr % 2 ^ (32 - len);
+			printf "%d.%d.%d.%d/%d\n", int(addr / 16777216),
+			       int(addr / 65536) % 256, int(addr / 256) % 256,
+			       addr % 256, len;
+		}
+	}'
+}
+
+load_table() {
+	local src
+
+	if [ -n "$dump" ]; then
+		src=$(awk '$1 ~ /^[0-9.]+(\/[0-9]+)?$/ { print $1 }' "$dump")
+	else
+		src=$(gen_prefixes)
+	fi
+
+	echo "$src" | sed 's/.*/route replace & dev dummy0 proto 99/' |
+		ip -net "$ns" -force -batch - 2>/dev/null
+	ip -net "$ns" route replace default dev dummy0 proto 99
+}
+
+# A structural change drops the current fib_dir and rebuilds it if the
+# sysctl allows, after a short settling delay.
+set_mode() {
+	ip netns exec "$ns" sysctl -qw net.ipv4.fib_dir_min_leaves="$1"
+	ip -net "$ns" route add 198.51.100.1/32 dev dummy0
+	ip -net "$ns" route del 198.51.100.1/32 dev dummy0
+	sleep 1
+}
+
+# Print the matched route for a fixed set of random destinations.
+lookup_sample() {
+	awk 'BEGIN {
+		srand(2);
+		for (i = 0; i < 2000; i++)
+			printf "route get fibmatch %d.%d.%d.%d\n",
+			       1 + int(rand() * 223), int(rand() * 256),
+			       int(rand() * 256), int(rand() * 256);
+	}' | ip -net "$ns" -batch - 2>&1
+}
+
+check_lookups() {
+	local off on
+
+	set_mode 0
+	off=$(lookup_sample)
+	set_mode 1
+	on=$(lookup_sample)
+
+	if [ "$off" != "$on" ]; then
+		echo "FAIL: lookups differ with fib_dir enabled"
+		diff <(echo "$off") <(echo "$on") | head -20
+		exit 1
+	fi
+	echo "lookups match with fib_dir on and off"
+}
+
+run_one() {
+	local stats=/sys/class/net/dummy0/statistics/tx_packets before after
+
+	before=$(ip netns exec "$ns" cat $stats)
+	ip netns exec "$ns" bash -c "
+		echo rem_device_all > $pg/kpktgend_0
+		echo add_device veth0 > $pg/kpktgend_0
+		echo count 0 > $pg/veth0
+		echo pkt_size 64 > $pg/veth0
+		echo src_min 192.0.2.2 > $pg/veth0
+		echo src_max 192.0.2.2 > $pg/veth0
+		echo dst_min 1.0.0.0 > $pg/veth0
+		echo dst_max 223.255.255.255 > $pg/veth0
+		echo flag IPDST_RND > $pg/veth0
+		echo dst_mac $mac > $pg/veth0
+		echo start > $pg/pgctrl &
+		sleep $duration
+		echo stop > $pg/pgctrl
+		wait"
+	after=$(ip netns exec "$ns" cat $stats)
+
+	echo $(((after - before) / duration))
+}
+
+load_table
+routes=$(ip -net "$ns" route show proto 99 | wc -l)
+echo "loaded $routes routes"
+
+check_lookups
+
+printf "%-12s %14s\n" "fib_dir" "packets/s"
+for mode in 0 1; do
+	set_mode $mode
+	printf "%-12s %14s\n" "$([ $mode -eq 0 ] && echo off || echo on)" \
+		"$(run_one)"
+done
+
+echo "PASS: fib_dir forwarding benchmark"
+exit 0
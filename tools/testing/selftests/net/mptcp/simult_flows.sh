@@ -13,12 +13,14 @@ test_cnt=1
 ret=0
 bail=0
 slack=50
+sched=""
 
 usage() {
-	echo "Usage: $0 [ -b ] [ -c ] [ -d ]"
+	echo "Usage: $0 [ -b ] [ -c ] [ -d ] [ -s scheduler ]"
 	echo -e "\t-b: bail out after first error, otherwise runs al testcases"
 	echo -e "\t-c: capture packets for each test using tcpdump (default: no capture)"
 	echo -e "\t-d: debug this script"
+	echo -e "\t-s: use the given MPTCP packet scheduler (default: all built-in ones)"
 }
 
 cleanup()
@@ -272,7 +274,7 @@ run_test()
 	fi
 }
 
-while getopts "bcdh" option;do
+while getopts "bcdhs:" option;do
 	case "$option" in
 	"h")
 		usage $0
@@ -287,6 +289,9 @@ while getopts "bcdh" option;do
 	"d")
 		set -x
 		;;
+	"s")
+		sched=$OPTARG
+		;;
 	"?")
 		usage $0
 		exit 1
@@ -294,12 +299,46 @@ while getopts "bcdh" option;do
 	esac
 done
 
+set_sched()
+{
+	local i
+
+	for i in "$ns1" "$ns3"; do
+		ip netns exec $i sysctl -q net.mptcp.scheduler=$1 2>/dev/null ||
+			return 1
+	done
+}
+
+run_tests()
+{
+	local tag=$1
+
+	run_test 10 10 0 0 "${tag}balanced bwidth"
+	run_test 10 10 1 50 "${tag}balanced bwidth with unbalanced delay"
+
+	# we still need some additional infrastructure to pass the following test-cases
+	run_test 30 10 0 0 "${tag}unbalanced bwidth"
+	run_test 30 10 1 50 "${tag}unbalanced bwidth with unbalanced delay"
+	run_test 30 10 50 1 "${tag}unbalanced bwidth with opposed, unbalanced delay"
+}
+
 setup
-run_test 10 10 0 0 "balanced bwidth"
-run_test 10 10 1 50 "balanced bwidth with unbalanced delay"
 
-# we still need some additional infrastructure to pass the following test-cases
-run_test 30 10 0 0 "unbalanced bwidth"
-run_test 30 10 1 50 "unbalanced bwidth with unbalanced delay"
-run_test 30 10 50 1 "unbalanced bwidth with opposed, unbalanced delay"
+if [ -n "$sched" ]; then
+	if ! set_sched $sched; then
+		echo "SKIP: MPTCP scheduler $sched not available"
+		exit $ksft_skip
+	fi
+	run_tests ""
+	exit $ret
+fi
+
+for sched in default roundrobin minrtt; do
+	# kernels without schedulers still run the default tests
+	if ! set_sched $sched && [ $sched != default ]; then
+		echo "SKIP: MPTCP scheduler $sched not available"
+		continue
+	fi
+	run_tests "$sched: "
+done
 exit $ret
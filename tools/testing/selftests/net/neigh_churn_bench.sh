@@ -0,0 +1,103 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Neighbour table churn benchmark.
+#
+# Fills the IPv4 neighbour table of a dummy device with many STALE entries,
+# deletes them again, and reports the add and delete rates over a few
+# rounds. A last round leaves the entries in place with a short
+# gc_stale_time and reports how long periodic gc takes to reclaim them.
+#
+# Usage: neigh_churn_bench.sh [-n neighbours] [-r rounds]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+nneigh=50000
+rounds=3
+
+while getopts "n:r:" o; do
+	case $o in
+	n) nneigh=$OPTARG ;;
+	r) rounds=$OPTARG ;;
+	*) echo "Usage: $0 [-n neighbours] [-r rounds]"
+	   exit 1 ;;
+	esac
+done
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-neigh-$sfx"
+batch=$(mktemp)
+
+cleanup() {
+	ip netns del "$ns" 2>/dev/null
+	rm -f "$batch" "$batch.del"
+}
+
+if ! command -v ip > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ip -net "$ns" link add dummy0 type dummy
+ip -net "$ns" link set dummy0 up
+ip -net "$ns" addr add 10.0.0.1/8 dev dummy0
+ip netns exec "$ns" sysctl -qw net.ipv4.neigh.default.gc_thresh1=1024
+ip netns exec "$ns" sysctl -qw net.ipv4.neigh.default.gc_thresh2=$((nneigh * 2))
+ip netns exec "$ns" sysctl -qw net.ipv4.neigh.default.gc_thresh3=$((nneigh * 4))
+
+awk -v n="$nneigh" 'BEGIN {
+	for (i = 2; i < n + 2; i++) {
+		a = int(i / 65536) % 256;
+		b = int(i / 256) % 256;
+		c = i % 256;
+		printf "neigh replace 10.%d.%d.%d lladdr 02:00:00:%02x:%02x:%02x dev dummy0 nud stale\n",
+			a, b, c, a, b, c;
+	}
+}' > "$batch"
+sed 's/^neigh replace \([^ ]*\) .*/neigh del \1 dev dummy0/' "$batch" > "$batch.del"
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+neigh_count() {
+	ip -4 -net "$ns" neigh show dev dummy0 | wc -l
+}
+
+rate() {
+	echo $((nneigh * 1000 / ($2 - $1 > 0 ? $2 - $1 : 1)))
+}
+
+printf "%-6s %14s %14s\n" "round" "adds/s" "dels/s"
+for r in $(seq 1 "$rounds"); do
+	t0=$(now_ms)
+	ip -net "$ns" -force -batch "$batch" 2>/dev/null
+	t1=$(now_ms)
+	ip -net "$ns" -force -batch "$batch.del" 2>/dev/null
+	t2=$(now_ms)
+	printf "%-6s %14s %14s\n" "$r" "$(rate $t0 $t1)" "$(rate $t1 $t2)"
+done
+
+ip netns exec "$ns" sysctl -qw net.ipv4.neigh.dummy0.gc_stale_time=1
+ip netns exec "$ns" sysctl -qw net.ipv4.neigh.default.base_reachable_time_ms=2000
+ip -net "$ns" -force -batch "$batch" 2>/dev/null
+loaded=$(neigh_count)
+t0=$(now_ms)
+while [ "$(neigh_count)" -gt 1024 ]; do
+	if [ $(($(now_ms) - t0)) -gt 120000 ]; then
+		echo "FAIL: periodic gc left $(neigh_count) of $loaded entries"
+		exit 1
+	fi
+	sleep 0.5
+done
+echo "periodic gc reclaimed $loaded entries in $(($(now_ms) - t0)) ms"
+
+echo "PASS: neighbour churn benchmark"
+exit 0
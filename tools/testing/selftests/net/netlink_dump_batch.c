@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Dump the IPv4 and IPv6 routing tables of the current netns twice, once
+ * one skb per round and once with NETLINK_DUMP_BATCH, and check that both
+ * dumps return the same messages.
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#ifndef SOL_NETLINK
+#define SOL_NETLINK		270
+#endif
+
+#ifndef NETLINK_DUMP_BATCH
+#define NETLINK_DUMP_BATCH	13
+#endif
+
+#define KSFT_SKIP		4
+#define RCVBUF_SIZE		(1 << 20)
+
+struct dump {
+	char *buf;
+	size_t len;
+	size_t size;
+	unsigned int nmsgs;
+	unsigned int nrecvs;
+};
+
+static void dump_append(struct dump *d, const struct nlmsghdr *nlh)
+{
+	if (d->len + nlh->nlmsg_len > d->size) {
+		d->size = (d->size + nlh->nlmsg_len) * 2;
+		d->buf = realloc(d->buf, d->size);
+		if (!d->buf) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	memcpy(d->buf + d->len, nlh, nlh->nlmsg_len);
+	/* the port id differs between the two sockets */
+	((struct nlmsghdr *)(d->buf + d->len))->nlmsg_pid = 0;
+	d->len += nlh->nlmsg_len;
+	d->nmsgs++;
+}
+
+static void do_dump(int family, int batch, struct dump *d)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct rtmsg rtm;
+	} req = {
+		.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtmsg)),
+		.nlh.nlmsg_type = RTM_GETROUTE,
+		.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+		.nlh.nlmsg_seq = 1,
+		.rtm.rtm_family = family,
+	};
+	static char rbuf[65536];
+	int rcvbuf = RCVBUF_SIZE;
+	int fd, one = 1;
+
+	fd = socket(AF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	if (batch &&
+	    setsockopt(fd, SOL_NETLINK, NETLINK_DUMP_BATCH, &one, sizeof(one))) {
+		if (errno == ENOPROTOOPT || errno == EPERM) {
+			printf("SKIP: NETLINK_DUMP_BATCH not available\n");
+			exit(KSFT_SKIP);
+		}
+		perror("setsockopt NETLINK_DUMP_BATCH");
+		exit(1);
+	}
+
+	if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+		perror("send");
+		exit(1);
+	}
+
+	for (;;) {
+		struct nlmsghdr *nlh;
+		ssize_t len;
+
+		len = recv(fd, rbuf, sizeof(rbuf), MSG_TRUNC);
+		if (len < 0) {
+			perror("recv");
+			exit(1);
+		}
+		if (len > sizeof(rbuf)) {
+			fprintf(stderr, "message truncated\n");
+			exit(1);
+		}
+		d->nrecvs++;
+
+		for (nlh = (struct nlmsghdr *)rbuf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(nlh);
+
+				fprintf(stderr, "dump failed: %s\n",
+					strerror(-err->error));
+				exit(1);
+			}
+
+			dump_append(d, nlh);
+			if (nlh->nlmsg_type == NLMSG_DONE) {
+				close(fd);
+				return;
+			}
+		}
+	}
+}
+
+static int check_family(int family, const char *name)
+{
+	struct dump plain = {}, batched = {};
+	int ret = 0;
+
+	do_dump(family, 0, &plain);
+	do_dump(family, 1, &batched);
+
+	if (plain.len != batched.len ||
+	    memcmp(plain.buf, batched.buf, plain.len)) {
+		fprintf(stderr,
+			"FAIL: %s dumps differ: %u messages in %u reads vs %u messages in %u reads\n",
+			name, plain.nmsgs, plain.nrecvs,
+			batched.nmsgs, batched.nrecvs);
+		ret = 1;
+	} else {
+		printf("%s: %u messages match, %u reads plain, %u reads batched\n",
+		       name, plain.nmsgs, plain.nrecvs, batched.nrecvs);
+	}
+
+	free(plain.buf);
+	free(batched.buf);
+	return ret;
+}
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= check_family(AF_INET, "ipv4");
+	ret |= check_family(AF_INET6, "ipv6");
+
+	return ret;
+}
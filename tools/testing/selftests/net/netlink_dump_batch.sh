@@ -0,0 +1,63 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Check that route dumps return the same messages with and without
+# NETLINK_DUMP_BATCH, on tables large enough to take many dump rounds.
+#
+# Usage: netlink_dump_batch.sh [-n routes]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+nroutes=20000
+
+while getopts "n:" o; do
+	case $o in
+	n) nroutes=$OPTARG ;;
+	*) echo "Usage: $0 [-n routes]"
+	   exit 1 ;;
+	esac
+done
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-nldump-$sfx"
+
+cleanup() {
+	ip netns del "$ns" 2>/dev/null
+}
+
+if ! command -v ip > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ip -net "$ns" link add dummy0 type dummy
+ip -net "$ns" link set dummy0 up
+
+awk -v n="$nroutes" 'BEGIN {
+	for (i = 0; i < n; i++) {
+		printf "route add 10.%d.%d.0/24 dev dummy0\n",
+		       int(i / 256) % 256, i % 256;
+		printf "route add 2001:db8:%x:%x::/64 dev dummy0\n",
+		       int(i / 65536), i % 65536;
+	}
+}' | ip -net "$ns" -batch -
+
+ip netns exec "$ns" ./netlink_dump_batch
+ret=$?
+
+if [ $ret -eq 0 ]; then
+	echo "PASS: batched and unbatched dumps match"
+elif [ $ret -eq $ksft_skip ]; then
+	echo "SKIP: netlink dump batching"
+else
+	echo "FAIL: batched and unbatched dumps differ"
+fi
+
+exit $ret
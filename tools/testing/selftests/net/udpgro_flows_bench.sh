@@ -0,0 +1,112 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Measure how well GRO keeps coalescing with many concurrent flows.
+#
+# pktgen sends UDP packets on one end of a veth pair, cycling through N
+# destination addresses, so that N flows are interleaved. The other end has
+# NAPI GRO and fraglist GRO enabled, and the packets seen after GRO are
+# counted from the netdev ingress hook. The average number of segments per
+# aggregated packet drops when GRO has to flush flows early.
+#
+# Usage: udpgro_flows_bench.sh [seconds per test] [flow counts...]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+duration=${1:-3}
+[ $# -gt 0 ] && shift
+flows=${*:-"1 8 32 64 128 256 512"}
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-gro-$sfx"
+pg=/proc/net/pktgen
+
+cleanup() {
+	ip netns del "$ns" 2>/dev/null
+}
+
+for tool in ip nft ethtool; do
+	if ! command -v $tool > /dev/null 2>&1; then
+		echo "SKIP: Could not run test without $tool tool"
+		exit $ksft_skip
+	fi
+done
+
+if ! modprobe -q pktgen 2>/dev/null && [ ! -d $pg ]; then
+	echo "SKIP: pktgen not available"
+	exit $ksft_skip
+fi
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ip -net "$ns" link add veth0 type veth peer name veth1
+ip -net "$ns" link set veth0 up
+ip -net "$ns" link set veth1 up
+if ! ip netns exec "$ns" ethtool -K veth1 gro on rx-gro-list on \
+   > /dev/null 2>&1; then
+	echo "SKIP: Could not enable GRO on veth"
+	exit $ksft_skip
+fi
+mac=$(ip netns exec "$ns" cat /sys/class/net/veth1/address)
+
+ip netns exec "$ns" nft -f - <<EOF2
+table netdev gro {
+	chain ingress {
+		type filter hook ingress device veth1 priority 0; policy accept;
+		counter drop
+	}
+}
+EOF2
+if [ $? -ne 0 ]; then
+	echo "SKIP: Could not load ruleset"
+	exit $ksft_skip
+fi
+
+run_one() {
+	local n=$1 sent aggr
+
+	ip netns exec "$ns" nft reset counters > /dev/null
+
+	ip netns exec "$ns" bash -c "
+		echo rem_device_all > $pg/kpktgend_0
+		echo add_device veth0 > $pg/kpktgend_0
+		echo count 0 > $pg/veth0
+		echo pkt_size 1000 > $pg/veth0
+		echo dst_min 10.1.0.1 > $pg/veth0
+		echo dst_max 10.1.$((n / 256)).$((n % 256)) > $pg/veth0
+		echo dst_mac $mac > $pg/veth0
+		echo udp_dst_min 9 > $pg/veth0
+		echo udp_dst_max 9 > $pg/veth0
+		echo start > $pg/pgctrl &
+		sleep $duration
+		echo stop > $pg/pgctrl
+		wait"
+
+	sent=$(ip netns exec "$ns" sed -n 's/.*pkts-sofar: \([0-9]*\).*/\1/p' \
+	       $pg/veth0)
+	aggr=$(ip netns exec "$ns" nft list chain netdev gro ingress |
+	       sed -n 's/.*counter packets \([0-9]*\).*/\1/p')
+
+	if [ -z "$sent" ] || [ -z "$aggr" ] || [ "$aggr" -eq 0 ]; then
+		echo "FAIL: no packets received with $n flows"
+		return 1
+	fi
+
+	printf "%-8s %12s %12s %10s.%02d\n" "$n" "$((sent / duration))" \
+	       "$((aggr / duration))" "$((sent / aggr))" \
+	       "$((sent * 100 / aggr % 100))"
+}
+
+ret=0
+printf "%-8s %12s %12s %13s\n" "flows" "pkts/s" "gro pkts/s" "segs/gro pkt"
+for n in $flows; do
+	run_one "$n" || ret=1
+done
+
+[ $ret -eq 0 ] && echo "PASS: udpgro flows benchmark"
+exit $ret
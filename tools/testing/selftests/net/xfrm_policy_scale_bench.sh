@@ -0,0 +1,154 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# xfrm policy lookup scaling benchmark.
+#
+# Installs many inexact "allow" policies that share the address prefixes
+# of the test traffic but differ in their port selector, so every lookup
+# has to consider all of them. Reports the policy insert rate and the
+# flood ping rate between two namespaces without policies, with the
+# candidate list search and with the compiled classifier
+# (net.core.xfrm_policy_tss_min). Also checks that a block policy of
+# higher priority still drops traffic, before and after the classifier
+# has been rebuilt for its bin.
+#
+# Usage: xfrm_policy_scale_bench.sh [-n policies] [-c pings]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+npol=4000
+count=20000
+
+while getopts "n:c:" o; do
+	case $o in
+	n) npol=$OPTARG ;;
+	c) count=$OPTARG ;;
+	*) echo "Usage: $0 [-n policies] [-c pings]"
+	   exit 1 ;;
+	esac
+done
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns1="ns1-xfrm-$sfx"
+ns2="ns2-xfrm-$sfx"
+batch=$(mktemp)
+
+cleanup() {
+	ip netns del "$ns1" 2>/dev/null
+	ip netns del "$ns2" 2>/dev/null
+	rm -f "$batch"
+}
+
+for tool in ip ping; do
+	if ! command -v $tool > /dev/null 2>&1; then
+		echo "SKIP: Could not run test without $tool tool"
+		exit $ksft_skip
+	fi
+done
+
+if ! ip netns add "$ns1" || ! ip netns add "$ns2"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ip -net "$ns1" link add veth0 type veth peer name veth0 netns "$ns2"
+ip -net "$ns1" addr add 10.0.0.1/24 dev veth0
+ip -net "$ns2" addr add 10.0.0.2/24 dev veth0
+ip -net "$ns1" link set veth0 up
+ip -net "$ns2" link set veth0 up
+
+if ! ip netns exec "$ns1" sysctl -qw net.core.xfrm_policy_tss_min=0; then
+	echo "SKIP: kernel lacks xfrm_policy_tss_min"
+	exit $ksft_skip
+fi
+
+awk -v n="$npol" 'BEGIN {
+	for (i = 1; i <= n; i++) {
+		printf "xfrm policy add src 10.0.0.0/24 dst 10.0.0.0/24 proto udp dport %d dir out priority %d action allow\n", i, i;
+		printf "xfrm policy add src 10.0.0.0/24 dst 10.0.0.0/24 proto udp dport %d dir in priority %d action allow\n", i, i;
+	}
+}' > "$batch"
+
+now_ms() {
+	echo $(($(date +%s%N) / 1000000))
+}
+
+rate() {
+	echo $(($1 * 1000 / ($3 - $2 > 0 ? $3 - $2 : 1)))
+}
+
+load() {
+	local t0 t1
+
+	ip -net "$ns1" xfrm policy flush
+	ip netns exec "$ns1" sysctl -qw net.core.xfrm_policy_tss_min="$1"
+	t0=$(now_ms)
+	if ! ip -net "$ns1" -batch "$batch"; then
+		echo "FAIL: could not install policies"
+		exit 1
+	fi
+	t1=$(now_ms)
+	echo "installed $((npol * 2)) policies, $(rate $((npol * 2)) $t0 $t1) policies/s"
+	# let the classifier build once the SPD is quiet
+	sleep 1
+}
+
+flood() {
+	local t0 t1
+
+	t0=$(now_ms)
+	if ! ip netns exec "$ns1" ping -q -f -c "$count" 10.0.0.2 > /dev/null; then
+		echo "FAIL: ping through $1 failed"
+		exit 1
+	fi
+	t1=$(now_ms)
+	printf "%-24s %12s pings/s\n" "$1" "$(rate $count $t0 $t1)"
+}
+
+ping_once() {
+	ip netns exec "$ns1" ping -q -c 1 -W 1 10.0.0.2 > /dev/null 2>&1
+}
+
+# expect_ping <0|1> <what>
+expect_ping() {
+	local ok=0
+
+	ping_once && ok=1
+	if [ $ok -ne "$1" ]; then
+		echo "FAIL: ping $([ "$1" -eq 1 ] && echo blocked || echo passed) $2"
+		exit 1
+	fi
+}
+
+check_block() {
+	local allow="src 10.0.0.0/16 dst 10.0.0.0/16 proto icmp dir out"
+	local block="src 10.0.0.0/24 dst 10.0.0.0/24 proto icmp dir out"
+
+	ip -net "$ns1" xfrm policy add $allow priority $((npol + 1)) action allow
+	sleep 1
+	expect_ping 1 "with a matching allow policy"
+
+	ip -net "$ns1" xfrm policy add $block priority 0 action block
+	expect_ping 0 "right after adding a block policy"
+	sleep 1
+	expect_ping 0 "with a block policy in the classifier"
+
+	ip -net "$ns1" xfrm policy delete $block
+	sleep 1
+	expect_ping 1 "after deleting the block policy"
+
+	ip -net "$ns1" xfrm policy delete $allow
+	echo "block policy takes precedence with the classifier"
+}
+
+flood "no policies"
+load 0
+flood "candidate lists"
+load 1
+flood "compiled classifier"
+check_block
+
+echo "PASS: xfrm policy scaling benchmark"
+exit 0
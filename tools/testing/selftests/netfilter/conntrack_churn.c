@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Conntrack insertion/expiry stress benchmark.
+ *
+ * Sends single UDP datagrams to unused ports on the loopback address
+ * range, never reusing a tuple within a run, so that every packet
+ * creates a new conntrack entry. Reports new connections per second
+ * and samples the table size to show whether expiry keeps up.
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CT_COUNT	"/proc/sys/net/netfilter/nf_conntrack_count"
+#define NR_PORTS	(65536 - 1024)
+
+static unsigned int cfg_duration = 10;
+static unsigned int cfg_threads = 1;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static long ct_count(void)
+{
+	long count = -1;
+	FILE *f;
+
+	f = fopen(CT_COUNT, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &count) != 1)
+		count = -1;
+	fclose(f);
+	return count;
+}
+
+/* Each worker owns the 127.<id>.x.y source addresses, so tuples never
+ * repeat across workers: 65536 sources times 64512 ports each.
+ */
+static int worker(unsigned int id, int out)
+{
+	struct sockaddr_in dst = { .sin_family = AF_INET };
+	uint64_t end = now_ns() + cfg_duration * 1000000000ull;
+	unsigned long long sent = 0;
+	unsigned int src = 0, port = 0;
+	int fd = -1;
+	char c = 0;
+
+	dst.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	while (now_ns() < end) {
+		if (fd < 0 || port == NR_PORTS) {
+			struct sockaddr_in sa = { .sin_family = AF_INET };
+
+			if (fd >= 0)
+				close(fd);
+			fd = socket(AF_INET, SOCK_DGRAM, 0);
+			if (fd < 0) {
+				perror("socket");
+				return 1;
+			}
+			sa.sin_addr.s_addr = htonl((127u << 24) |
+						   ((id + 1) << 16) | src++);
+			if (bind(fd, (void *)&sa, sizeof(sa))) {
+				perror("bind");
+				return 1;
+			}
+			port = 0;
+		}
+
+		dst.sin_port = htons(1024 + port++);
+		/* ECONNREFUSED from a previous ICMP error is expected */
+		if (sendto(fd, &c, 1, MSG_DONTWAIT, (void *)&dst,
+			   sizeof(dst)) < 0 &&
+		    errno != ECONNREFUSED && errno != EAGAIN) {
+			perror("sendto");
+			return 1;
+		}
+		sent++;
+	}
+
+	if (write(out, &sent, sizeof(sent)) != sizeof(sent))
+		return 1;
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-t seconds] [-j threads]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long total = 0, sent;
+	long count, peak = 0, start;
+	unsigned int i, elapsed;
+	int c, pfd[2], ret = 0;
+	uint64_t t0;
+
+	while ((c = getopt(argc, argv, "t:j:")) != -1) {
+		switch (c) {
+		case 't':
+			cfg_duration = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			cfg_threads = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!cfg_duration || !cfg_threads || cfg_threads > 254)
+		usage(argv[0]);
+
+	start = ct_count();
+	if (start < 0) {
+		fprintf(stderr, "cannot read %s, conntrack not loaded?\n",
+			CT_COUNT);
+		return 4;
+	}
+
+	if (pipe(pfd)) {
+		perror("pipe");
+		return 1;
+	}
+
+	t0 = now_ns();
+	for (i = 0; i < cfg_threads; i++) {
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (!pid)
+			exit(worker(i, pfd[1]));
+	}
+
+	/* sample the table while the workers run */
+	for (elapsed = 0; elapsed < cfg_duration; elapsed++) {
+		sleep(1);
+		count = ct_count();
+		if (count > peak)
+			peak = count;
+		printf("t=%3us entries=%ld\n", elapsed + 1, count);
+	}
+
+	for (i = 0; i < cfg_threads; i++) {
+		int status;
+
+		wait(&status);
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = 1;
+		else if (read(pfd[0], &sent, sizeof(sent)) == sizeof(sent))
+			total += sent;
+	}
+
+	printf("new connections: %llu in %.2fs, %.0f conn/s, peak entries %ld\n",
+	       total, (now_ns() - t0) / 1e9,
+	       total / ((now_ns() - t0) / 1e9), peak);
+
+	return ret;
+}
@@ -0,0 +1,66 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Conntrack churn benchmark: create new UDP conntracks as fast as
+# possible in a private netns, with a short timeout so that expiry has
+# to keep up with insertion, and report new connections per second.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+duration=${1:-10}
+threads=${2:-$(nproc)}
+[ "$threads" -gt 254 ] && threads=254
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-churn-$sfx"
+
+cleanup() {
+	ip netns del "$ns"
+}
+
+if ! nft --version > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without nft tool"
+	exit $ksft_skip
+fi
+
+if ! ip -Version > /dev/null 2>&1; then
+	echo "SKIP: Could not run test without ip tool"
+	exit $ksft_skip
+fi
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ip -net "$ns" link set lo up
+
+ip netns exec "$ns" nft -f - <<EOF2
+table inet filter {
+	chain output {
+		type filter hook output priority 0; policy accept;
+		ct state new counter
+	}
+}
+EOF2
+if [ $? -ne 0 ]; then
+	echo "SKIP: Could not load conntrack ruleset"
+	exit $ksft_skip
+fi
+
+ip netns exec "$ns" sysctl -q net.netfilter.nf_conntrack_udp_timeout=2
+
+ip netns exec "$ns" ./conntrack_churn -t "$duration" -j "$threads"
+ret=$?
+
+if [ $ret -eq 0 ]; then
+	echo "PASS: conntrack churn benchmark"
+elif [ $ret -eq $ksft_skip ]; then
+	echo "SKIP: conntrack churn benchmark"
+else
+	echo "FAIL: conntrack churn benchmark"
+fi
+
+exit $ret
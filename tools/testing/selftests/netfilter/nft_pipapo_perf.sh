@@ -0,0 +1,142 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Compare lookup rates of the generic and the vectorised (AVX2 on x86_64,
+# NEON on arm64) pipapo set implementations, for IPv4 address and port
+# interval sets of growing size.
+#
+# Packets are generated by pktgen on one end of a veth pair, and matched
+# against the set from the netdev ingress hook of the other end. The
+# implementation is picked on set creation, depending on the nf_tables
+# pipapo_simd module parameter.
+#
+# Usage: nft_pipapo_perf.sh [seconds per test] [set sizes...]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+duration=${1:-5}
+[ $# -gt 0 ] && shift
+sizes=${*:-"100 1000 10000 50000"}
+
+sfx=$(mktemp -u "XXXXXXXX")
+ns="ns-pipapo-$sfx"
+param=/sys/module/nf_tables/parameters/pipapo_simd
+pg=/proc/net/pktgen
+
+cleanup() {
+	[ -n "$saved" ] && echo "$saved" > "$param"
+	ip netns del "$ns" 2>/dev/null
+}
+
+for tool in nft ip; do
+	if ! command -v $tool > /dev/null 2>&1; then
+		echo "SKIP: Could not run test without $tool tool"
+		exit $ksft_skip
+	fi
+done
+
+if ! modprobe -q pktgen 2>/dev/null && [ ! -d /proc/net/pktgen ]; then
+	echo "SKIP: pktgen not available"
+	exit $ksft_skip
+fi
+
+modprobe -q nf_tables 2>/dev/null
+if [ ! -w "$param" ]; then
+	echo "SKIP: nf_tables pipapo_simd parameter not available"
+	exit $ksft_skip
+fi
+saved=$(cat "$param")
+
+case $(uname -m) in
+x86_64)
+	grep -qw avx2 /proc/cpuinfo && simd=avx2 ;;
+aarch64)
+	simd=neon ;;
+esac
+
+if ! ip netns add "$ns"; then
+	echo "SKIP: Could not create net namespace"
+	exit $ksft_skip
+fi
+trap cleanup EXIT
+
+ip -net "$ns" link add veth0 type veth peer name veth1
+ip -net "$ns" link set veth0 up
+ip -net "$ns" link set veth1 up
+mac=$(ip netns exec "$ns" cat /sys/class/net/veth1/address)
+
+# Each element is 10.<i / 256>.<i % 256>.0/24 . <1024 + i % 1000>-<+1023>,
+# packets match the last one.
+load_set() {
+	local size=$1 i
+
+	{
+		echo "flush ruleset"
+		echo "table netdev perf {"
+		echo "	set s {"
+		echo "		type ipv4_addr . inet_service"
+		echo "		flags interval"
+		echo "		elements = {"
+		for ((i = 0; i < size; i++)); do
+			echo "			10.$((i / 256 % 256)).$((i % 256)).0/24 . $((1024 + i % 1000))-$((2047 + i % 1000)),"
+		done
+		echo "		}"
+		echo "	}"
+		echo "	chain ingress {"
+		echo "		type filter hook ingress device veth1 priority 0; policy accept;"
+		echo "		ip daddr . udp dport @s counter drop"
+		echo "	}"
+		echo "}"
+	} | ip netns exec "$ns" nft -f -
+}
+
+run_one() {
+	local size=$1 i=$(($1 - 1)) pkts
+
+	ip netns exec "$ns" bash -c "
+		echo rem_device_all > $pg/kpktgend_0
+		echo add_device veth0 > $pg/kpktgend_0
+		echo count 0 > $pg/veth0
+		echo pkt_size 64 > $pg/veth0
+		echo dst 10.$((i / 256 % 256)).$((i % 256)).1 > $pg/veth0
+		echo dst_mac $mac > $pg/veth0
+		echo udp_dst_min $((1024 + i % 1000)) > $pg/veth0
+		echo udp_dst_max $((1024 + i % 1000)) > $pg/veth0
+		echo start > $pg/pgctrl &
+		sleep $duration
+		echo stop > $pg/pgctrl
+		wait"
+
+	pkts=$(ip netns exec "$ns" nft list chain netdev perf ingress |
+	       sed -n 's/.*counter packets \([0-9]*\).*/\1/p')
+
+	echo $((pkts / duration))
+}
+
+ret=0
+printf "%-8s %12s %12s\n" "size" "generic" "${simd:-simd}"
+for size in $sizes; do
+	line=$(printf "%-8s" "$size")
+
+	for mode in 0 1; do
+		echo $mode > "$param"
+		if ! load_set "$size"; then
+			echo "FAIL: could not load set with $size elements"
+			ret=1
+			continue 2
+		fi
+
+		if [ $mode -eq 1 ] && [ -z "$simd" ]; then
+			line="$line $(printf "%12s" "n/a")"
+			continue
+		fi
+
+		line="$line $(printf "%12s" "$(run_one "$size")")"
+	done
+
+	echo "$line"
+done
+
+[ $ret -eq 0 ] && echo "PASS: pipapo lookup benchmark (packets/s)"
+exit $ret